@@ -10,8 +10,19 @@
 #include <linux/fs.h>
 #include <linux/device.h>
 #include <linux/uaccess.h>
-#include <linux/semaphore.h>
+#include <linux/uio.h>
 #include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/list_sort.h>
+#include <linux/llist.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/atomic.h>
+#include <linux/ktime.h>
+#include <linux/lz4.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
 
 #define DEVICE_NAME "ebbchar"
 #define CLASS_NAME "ebb"
@@ -21,17 +32,86 @@ MODULE_AUTHOR("Maíra Canal");
 MODULE_DESCRIPTION("Simple char device for BBB");
 MODULE_VERSION("0.0.1");
 
-static int majorNumber;
-static int numberOpens = 0;
-static struct class* ebbcharClass = NULL;
+static bool compress = 0;
+module_param(compress, bool, S_IRUGO);
+MODULE_PARM_DESC(compress, "Store written data LZ4 compressed = 1; Store it plain = 0 (default)");
+
+static unsigned int chunkSize = 4096;
+module_param(chunkSize, uint, S_IRUGO);
+MODULE_PARM_DESC(chunkSize, "Size in bytes of each chunk allocation, header included (default = 4096)");
+
+static unsigned long maxStored = 4 * 1024 * 1024;
+module_param(maxStored, ulong, S_IRUGO);
+MODULE_PARM_DESC(maxStored, "Maximum memory in bytes used by the queued chunks, 0 = no limit (default = 4 MiB)");
+
+/**
+ * @brief A piece of the data written to the device
+ *
+ * Writes are split in chunks of at most chunkData bytes, so that an uncompressed chunk with its
+ * header fits a chunkSize allocation. Each chunk is compressed on its own, so a read only has
+ * to decompress the chunk it is consuming. A chunk is read by a single file: once a reader takes
+ * it, the rest of it is sent on the next reads of that same file. If the file is closed first,
+ * the rest goes back to the head of the queue.
+ */
+struct ebbchar_chunk {
+    struct llist_node node; // entry in a per-CPU submission queue
+    struct list_head list;  // entry in the ready list
+    u64 seq;                // sequence number of the write that queued the chunk
+    size_t len;             // size of the data as written by the user
+    size_t storedLen;       // size of data[]
+    size_t footprint;       // memory really used by the chunk, as reported by ksize()
+    size_t readPos;         // bytes of this chunk already sent to the user
+    bool isCompressed;
+    char data[];
+};
+
+/**
+ * @brief State of each opened file, kept at filep->private_data
+ *
+ * Every file has its own staging and compression buffers, so readers and writers on different
+ * files never share them. The locks only serialize threads that share the same file.
+ */
+struct ebbchar_file {
+    struct mutex readLock;
+    struct mutex writeLock;
+    struct ebbchar_chunk *chunk;    // chunk being read by this file
+    bool compress;                  // value of the compress parameter when the file was opened
+    char *readBuffer;               // decompressed copy of chunk
+    char *writeBuffer;
+    char *lz4Buffer;
+    void *lz4WorkMem;
+};
+
+static size_t chunkData;    // data bytes that fit in a chunkSize allocation
+static atomic_t numberOpens = ATOMIC_INIT(0);
 static struct device* ebbcharDevice = NULL;
 
-static DEFINE_SEMAPHORE(semaphore);
+/*
+ * Writers push their chunks to the submission queue of the CPU they are running on with
+ * llist_add_batch(), which is lock-free. Readers take readyLock, move everything submitted
+ * so far to the ready list ordered by write sequence, and pop the first chunk.
+ */
+static DEFINE_PER_CPU(struct llist_head, submitQueue);
+static DEFINE_SPINLOCK(readyLock);
+static LIST_HEAD(readyList);
+static atomic64_t writeSeq = ATOMIC64_INIT(0);
+
+static atomic64_t queuedBytes = ATOMIC64_INIT(0);
+static atomic64_t storedBytes = ATOMIC64_INIT(0);
+static atomic64_t compressTime = ATOMIC64_INIT(0);
+static atomic64_t decompressTime = ATOMIC64_INIT(0);
 
 static int dev_open(struct inode*, struct file*);                        
 static int dev_release(struct inode*, struct file*);                    
-static ssize_t dev_read(struct file *, char *, size_t, loff_t *);         
-static ssize_t dev_write(struct file *, const char *, size_t, loff_t *); 
+static ssize_t dev_read_iter(struct kiocb *, struct iov_iter *);
+static ssize_t dev_write_iter(struct kiocb *, struct iov_iter *);
+
+static ssize_t queuedBytes_show(struct device *dev, struct device_attribute *attr, char *buf);
+static ssize_t storedBytes_show(struct device *dev, struct device_attribute *attr, char *buf);
+static ssize_t ratio_show(struct device *dev, struct device_attribute *attr, char *buf);
+static ssize_t compressTime_show(struct device *dev, struct device_attribute *attr, char *buf);
+static ssize_t decompressTime_show(struct device *dev, struct device_attribute *attr, char *buf);
+static ssize_t numberOpens_show(struct device *dev, struct device_attribute *attr, char *buf);
 
 /** 
  * @brief Devices are represented as file structure in the kernel. 
@@ -40,148 +120,517 @@ static ssize_t dev_write(struct file *, const char *, size_t, loff_t *);
  * associated to the file operations
  */
 static struct file_operations fops = {
+    .owner = THIS_MODULE,
     .open = dev_open,
-    .read = dev_read,
-    .write = dev_write,
+    .read_iter = dev_read_iter,
+    .write_iter = dev_write_iter,
     .release = dev_release,
 };
 
-/** @brief LKM initialization function
- *  Function used at initialization time and is responsable for allocating dynamically
- *  the major number, registering device class, device driver and semaphore.
- *  @return returns 0 if successful
+// Stats exposed at /sys/class/ebb/ebbchar
+static DEVICE_ATTR_RO(queuedBytes);
+static DEVICE_ATTR_RO(storedBytes);
+static DEVICE_ATTR_RO(ratio);
+static DEVICE_ATTR_RO(compressTime);
+static DEVICE_ATTR_RO(decompressTime);
+static DEVICE_ATTR_RO(numberOpens);
+
+static struct attribute *ebbchar_attrs[] = {
+    &dev_attr_queuedBytes.attr,
+    &dev_attr_storedBytes.attr,
+    &dev_attr_ratio.attr,
+    &dev_attr_compressTime.attr,
+    &dev_attr_decompressTime.attr,
+    &dev_attr_numberOpens.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(ebbchar);
+
+/** @brief Frees a chunk and removes what is left of it from the stats
+ *  @param chunk The chunk, already out of any queue
  */
-static int __init ebbchar_init(void) {
+static void ebbchar_free_chunk(struct ebbchar_chunk *chunk) {
+    atomic64_sub(chunk->len - chunk->readPos, &queuedBytes);
+    atomic64_sub(chunk->footprint, &storedBytes);
+    kfree(chunk);
+}
 
-    printk(KERN_INFO "EBBChar: initializing the EBBChar LKM\n");
+static int ebbchar_chunk_cmp(void *priv, const struct list_head *a, const struct list_head *b) {
+    const struct ebbchar_chunk *chunkA = list_entry(a, struct ebbchar_chunk, list);
+    const struct ebbchar_chunk *chunkB = list_entry(b, struct ebbchar_chunk, list);
 
-    // Dynamically allocate a major number for a device
-    majorNumber = register_chrdev(0, DEVICE_NAME, &fops);
+    return chunkA->seq > chunkB->seq;
+}
 
-    if (majorNumber < 0) {
-        printk(KERN_ALERT "EBBChar: failed to register major number\n");
-        return majorNumber;
+/** @brief Moves the chunks of all the submission queues to the end of the ready list.
+ *  A write only returns after its chunks are submitted, so sorting them by sequence keeps
+ *  the data of each writer in order. Must be called with readyLock held.
+ */
+static void ebbchar_collect_chunks(void) {
+    LIST_HEAD(submitted);
+    struct ebbchar_chunk *chunk, *tmp;
+    struct llist_node *nodes;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        nodes = llist_reverse_order(llist_del_all(per_cpu_ptr(&submitQueue, cpu)));
+        llist_for_each_entry_safe(chunk, tmp, nodes, node)
+            list_add_tail(&chunk->list, &submitted);
     }
-    printk(KERN_INFO "EBBChar: registered correctly with major number\n");
 
-    // Register the device class
-    ebbcharClass = class_create(THIS_MODULE, CLASS_NAME);
-    if (IS_ERR(ebbcharClass)) {
-        unregister_chrdev(majorNumber, DEVICE_NAME);
-        printk(KERN_ALERT "EBBChar: failed to register device class\n");
-        return PTR_ERR(ebbcharClass);
-    }
-    printk(KERN_INFO "EBBChar: device class registered correctly\n");
+    list_sort(NULL, &submitted, ebbchar_chunk_cmp);
+    list_splice_tail(&submitted, &readyList);
+}
 
-    // Register the device driver
-    ebbcharDevice = device_create(ebbcharClass, NULL, MKDEV(majorNumber, 0), NULL, DEVICE_NAME);
-    if (IS_ERR(ebbcharDevice)) {
-        class_destroy(ebbcharClass);
-        class_unregister(ebbcharClass);
-        unregister_chrdev(majorNumber, DEVICE_NAME);
-        printk(KERN_ALERT "EBBChar: failed to create the device\n");
-        return PTR_ERR(ebbcharDevice);
-    }
-    printk(KERN_INFO "EBBChar: device class created correctly\n");
+/** @brief Takes the oldest chunk queued in the device
+ *  @return returns the chunk, or NULL if there is no data queued
+ */
+static struct ebbchar_chunk *ebbchar_pop_chunk(void) {
+    struct ebbchar_chunk *chunk;
 
-    sema_init(&semaphore, 5);
-    printk(KERN_INFO "EBBChar: semaphore initialized");
+    spin_lock(&readyLock);
 
-    return 0;
+    if (list_empty(&readyList))
+        ebbchar_collect_chunks();
+
+    chunk = list_first_entry_or_null(&readyList, struct ebbchar_chunk, list);
+    if (chunk)
+        list_del(&chunk->list);
 
+    spin_unlock(&readyLock);
+    return chunk;
 }
 
-/** @brief LKM cleanup function
- *  Function responsable for destroying all classes, devices and major number
+/** @brief Puts back a partially read chunk at the head of the queue, so the next reader
+ *  receives the rest of it. Its readPos is kept, and it is decompressed again when taken.
+ *  @param chunk The chunk, already out of any queue
  */
-static void __exit ebbchar_exit(void) {
-    
-    device_destroy(ebbcharClass,  MKDEV(majorNumber, 0));     // remove the device
-    class_unregister(ebbcharClass);                           // unregister the device class
-    class_destroy(ebbcharClass);                              // remove the device class
-    unregister_chrdev(majorNumber, DEVICE_NAME);              // unregister the major number
+static void ebbchar_requeue_chunk(struct ebbchar_chunk *chunk) {
+    spin_lock(&readyLock);
+    list_add(&chunk->list, &readyList);
+    spin_unlock(&readyLock);
+}
 
-    printk(KERN_INFO "EBBChar: Goodbye from the LKM!\n");
+/** @brief Frees the per-file state and its buffers
+ *  @param file The per-file state
+ */
+static void ebbchar_free_file(struct ebbchar_file *file) {
+    if (file->chunk)
+        ebbchar_requeue_chunk(file->chunk);
+
+    kvfree(file->readBuffer);
+    kvfree(file->writeBuffer);
+    kvfree(file->lz4Buffer);
+    vfree(file->lz4WorkMem);
+    kfree(file);
+}
+
+/** @brief Allocates the per-file state and the buffers used to stage and compress the chunks
+ *  @return returns the per-file state, or NULL if there is no memory
+ */
+static struct ebbchar_file *ebbchar_alloc_file(void) {
+    struct ebbchar_file *file;
 
+    file = kzalloc(sizeof(*file), GFP_KERNEL);
+    if (!file)
+        return NULL;
+
+    mutex_init(&file->readLock);
+    mutex_init(&file->writeLock);
+
+    // Any file may read chunks that another file compressed
+    file->writeBuffer = kvmalloc(chunkData, GFP_KERNEL);
+    file->readBuffer = kvmalloc(chunkData, GFP_KERNEL);
+    if (!file->writeBuffer || !file->readBuffer)
+        goto fail;
+
+    file->compress = compress;
+    if (!file->compress)
+        return file;
+
+    file->lz4Buffer = kvmalloc(LZ4_compressBound(chunkData), GFP_KERNEL);
+    file->lz4WorkMem = vmalloc(LZ4_MEM_COMPRESS);
+    if (!file->lz4Buffer || !file->lz4WorkMem)
+        goto fail;
+
+    return file;
+
+fail:
+    ebbchar_free_file(file);
+    return NULL;
+}
+
+/** @brief Checks the chunkSize parameter and sets how much data fits in each chunk. Chunks are
+ *  allocated with kmalloc(), so chunkSize can not go over KMALLOC_MAX_SIZE.
+ *  @return returns 0 if successful
+ */
+static int ebbchar_check_chunk_size(void) {
+    if (chunkSize <= sizeof(struct ebbchar_chunk) || chunkSize > KMALLOC_MAX_SIZE ||
+        chunkSize > LZ4_MAX_INPUT_SIZE) {
+        printk(KERN_ALERT "EBBChar: invalid chunk size %u\n", chunkSize);
+        return -EINVAL;
+    }
+    chunkData = chunkSize - sizeof(struct ebbchar_chunk);
+    return 0;
 }
 
-/** @brief The device open function that is called each time the device is opened
+/** @brief Checks the parameters and sets up the submission queues. Kept apart from
+ *  ebbchar_init so the KUnit suites can run it without registering the device.
+ *  @return returns 0 if successful
+ */
+static int ebbchar_setup(void) {
+    int cpu, ret;
+
+    ret = ebbchar_check_chunk_size();
+    if (ret)
+        return ret;
+
+    for_each_possible_cpu(cpu)
+        init_llist_head(per_cpu_ptr(&submitQueue, cpu));
+
+    return 0;
+}
+
+/** @brief Drops the data that was never read. No file may be open.
+ */
+static void ebbchar_drop_chunks(void) {
+    struct ebbchar_chunk *chunk, *tmp;
+
+    spin_lock(&readyLock);
+    ebbchar_collect_chunks();
+    list_for_each_entry_safe(chunk, tmp, &readyList, list) {
+        list_del(&chunk->list);
+        ebbchar_free_chunk(chunk);
+    }
+    spin_unlock(&readyLock);
+}
+
+/** @brief The device open function that is called each time the device is opened.
+ *  Any number of files can be opened at the same time, each with its own state.
  *  @param inodep A pointer to an inode object (defined in linux/fs.h)
  *  @param filep A pointer to a file object (defined in linux/fs.h)
  *  @return returns 0 if successful
  */
 static int dev_open(struct inode* inodep, struct file* filep){
 
-    // Tries to hold a semaphore
-    if (down_trylock(&semaphore) != 0) {
-        printk(KERN_ALERT "EBBChar: device in use by another process\n");
-        return -EBUSY; 
+    filep->private_data = ebbchar_alloc_file();
+    if (!filep->private_data) {
+        printk(KERN_ALERT "EBBChar: failed to allocate the file state\n");
+        return -ENOMEM;
     }
-    
-    numberOpens++;
-    printk(KERN_INFO "EBBChar: device has been opened %d time(s)\n", numberOpens);
+
+    printk(KERN_INFO "EBBChar: device has been opened %d time(s)\n", atomic_inc_return(&numberOpens));
     return 0;
 
 }
 
-/** @brief The device release function that is called each time the device is released 
+/** @brief The device release function that is called each time the device is released.
+ *  A chunk that was partially read by this file goes back to the head of the queue.
  *  @param inodep A pointer to an inode object (defined in linux/fs.h)
  *  @param filep A pointer to a file object (defined in linux/fs.h)
  *  @return returns 0 if successful
  */
 static int dev_release(struct inode* inodep, struct file* filep) {
 
-    // Realeases a semaphore
-    up(&semaphore);
+    ebbchar_free_file(filep->private_data);
     printk(KERN_INFO "EBBChar: device successfully closed\n");
     return 0;
 
 }
 
+/** @brief Takes the oldest queued chunk, decompressing it first if needed, and copies it to
+ *  the destination with copy_to_iter(), capturing any errors. A chunk that does not fit in the
+ *  destination is kept by the file and the rest of it is sent on its next read.
+ *  @param file The per-file state of the reader
+ *  @param to The destination of the data
+ *  @return returns the number of bytes sent, 0 if there is no data queued
+ */
+static ssize_t ebbchar_read(struct ebbchar_file *file, struct iov_iter *to) {
+    size_t len = iov_iter_count(to);
+    struct ebbchar_chunk *chunk;
+    const char *data;
+    size_t count;
+    ktime_t start;
+    int result;
+
+    mutex_lock(&file->readLock);
+
+    chunk = file->chunk;
+    if (!chunk) {
+        chunk = ebbchar_pop_chunk();
+        if (!chunk) {
+            mutex_unlock(&file->readLock);
+            return 0;
+        }
+
+        if (chunk->isCompressed) {
+            start = ktime_get();
+            result = LZ4_decompress_safe(chunk->data, file->readBuffer, chunk->storedLen, chunkData);
+            atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)), &decompressTime);
+
+            if (result != chunk->len) {
+                ebbchar_free_chunk(chunk);
+                mutex_unlock(&file->readLock);
+                printk(KERN_ALERT "EBBChar: failed to decompress a chunk\n");
+                return -EIO;
+            }
+        }
+        file->chunk = chunk;
+    }
+
+    data = chunk->isCompressed ? file->readBuffer : chunk->data;
+    count = min(len, chunk->len - chunk->readPos);
+
+    // copy_to_iter has the args (*from, size, *to) and returns the number of bytes copied
+    if (copy_to_iter(data + chunk->readPos, count, to) != count) {
+        mutex_unlock(&file->readLock);
+        printk(KERN_INFO "EBBChar: failed to send %zu characters to the user\n", count);
+        return -EFAULT;
+    }
+
+    chunk->readPos += count;
+    atomic64_sub(count, &queuedBytes);
+    if (chunk->readPos == chunk->len) {
+        file->chunk = NULL;
+        ebbchar_free_chunk(chunk);
+    }
+
+    mutex_unlock(&file->readLock);
+
+    pr_debug("EBBChar: sent %zu characters to the user\n", count);
+    return count;
+}   
+
 /** @brief This function is called whenever data is being sent from the device to the 
- *  user. In this case is uses the copy_to_user() function to send the buffer string
- *  to the user and captures any errors.
- *  @param filep A pointer to a file object (defined in linux/fs.h)
- *  @param buffer The pointer to the buffer to which this function writes the data
- *  @param len The length of the buffer
- *  @param offset The offset if required
- *  @return returns 0 if successful
+ *  user. The data is sent by ebbchar_read().
+ *  @param iocb The I/O control block, holding the file object (defined in linux/fs.h)
+ *  @param to The user buffers to which this function writes the data
+ *  @return returns the number of bytes sent, 0 if there is no data queued
  */
-static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *offset) {
-    int error_count = 0;
+static ssize_t dev_read_iter(struct kiocb *iocb, struct iov_iter *to) {
+    return ebbchar_read(iocb->ki_filp->private_data, to);
+}
 
-    // copy_to_user has the args (*to, *from, size) and returns 0 on success
-    error_count = copy_to_user(buffer, filep->private_data, strlen(filep->private_data));
+/** @brief Copies a piece of the user data into a new chunk. If compression is enabled the
+ *  chunk is stored compressed, unless LZ4 can not make it any smaller.
+ *  @param file The per-file state of the writer
+ *  @param from The source of the data
+ *  @param len The length of the data, at most chunkData
+ *  @return returns the chunk, or an ERR_PTR() on failure
+ */
+static struct ebbchar_chunk *ebbchar_make_chunk(struct ebbchar_file *file, struct iov_iter *from, size_t len) {
+    struct ebbchar_chunk *chunk;
+    const char *data;
+    size_t storedLen = len;
+    int compressedLen = 0;
+    ktime_t start;
+
+    // copy_from_iter has the args (*to, size, *from) and returns the number of bytes copied
+    if (copy_from_iter(file->writeBuffer, len, from) != len)
+        return ERR_PTR(-EFAULT);
+    data = file->writeBuffer;
+
+    if (file->compress) {
+        start = ktime_get();
+        compressedLen = LZ4_compress_default(file->writeBuffer, file->lz4Buffer, len,
+                                             LZ4_compressBound(chunkData), file->lz4WorkMem);
+        atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)), &compressTime);
+
+        if (compressedLen > 0 && compressedLen < len) {
+            data = file->lz4Buffer;
+            storedLen = compressedLen;
+        }
+    }
+
+    chunk = kmalloc(struct_size(chunk, data, storedLen), GFP_KERNEL);
+    if (!chunk)
+        return ERR_PTR(-ENOMEM);
 
-    if (!error_count) {
-        printk(KERN_INFO "EBBChar: sent %d characters to the user\n", (int) strlen(filep->private_data));
-        kfree(filep->private_data);
+    // Accounts the slab bucket the chunk landed in, not only its data
+    chunk->footprint = ksize(chunk);
+    if (atomic64_add_return(chunk->footprint, &storedBytes) > maxStored && maxStored) {
+        atomic64_sub(chunk->footprint, &storedBytes);
+        kfree(chunk);
+        return ERR_PTR(-ENOSPC);
+    }
+
+    chunk->len = len;
+    chunk->storedLen = storedLen;
+    chunk->readPos = 0;
+    chunk->isCompressed = (data == file->lz4Buffer);
+    memcpy(chunk->data, data, storedLen);
+
+    atomic64_add(len, &queuedBytes);
+
+    return chunk;
+}
+
+/** @brief Splits the data in chunks of at most chunkData bytes, which are submitted together
+ *  to the queue of the current CPU. When the queued chunks already use maxStored bytes, the
+ *  write stops there and fails with -ENOSPC if nothing was queued.
+ *  @param file The per-file state of the writer
+ *  @param from The source of the data
+ *  @return returns the number of bytes queued
+ */
+static ssize_t ebbchar_write(struct ebbchar_file *file, struct iov_iter *from) {
+    size_t len = iov_iter_count(from);
+    struct ebbchar_chunk *chunk = NULL, *first = NULL, *last = NULL;
+    struct llist_node *node;
+    size_t done = 0;
+    size_t count;
+    u64 seq;
+
+    if (!len)
         return 0;
+
+    mutex_lock(&file->writeLock);
+
+    // The batch is linked newest first, as the llist is reversed when collected
+    while (done < len) {
+        count = min_t(size_t, len - done, chunkData);
+
+        chunk = ebbchar_make_chunk(file, from, count);
+        if (IS_ERR(chunk))
+            break;
+
+        chunk->node.next = first ? &first->node : NULL;
+        first = chunk;
+        if (!last)
+            last = chunk;
+
+        done += count;
     }
 
-    printk(KERN_INFO "EBBChar: failed to send %d characters to the user\n", error_count);
-    return -EFAULT;
-}   
+    mutex_unlock(&file->writeLock);
+
+    if (!first)
+        return PTR_ERR(chunk);
+
+    seq = atomic64_inc_return(&writeSeq);
+    for (node = &first->node; node; node = node->next)
+        llist_entry(node, struct ebbchar_chunk, node)->seq = seq;
+    llist_add_batch(&first->node, &last->node, raw_cpu_ptr(&submitQueue));
+
+    pr_debug("EBBChar: received %zu characters from the user\n", done);
+    return done;
+}
 
 /** @brief This function is called whenever data is being sent from the user to the 
- *  device. In this case is uses the copy_from_user() function to receive the buffer string
- *  from the user and captures any errors.
- *  @param filep A pointer to a file object (defined in linux/fs.h)
- *  @param buffer The pointer to the buffer to which this function writes the data
- *  @param len The length of the buffer
- *  @param offset The offset if required
+ *  device. The data is queued by ebbchar_write().
+ *  @param iocb The I/O control block, holding the file object (defined in linux/fs.h)
+ *  @param from The user buffers from which this function reads the data
+ *  @return returns the number of bytes queued
+ */
+static ssize_t dev_write_iter(struct kiocb *iocb, struct iov_iter *from) {
+    return ebbchar_write(iocb->ki_filp->private_data, from);
+}
+
+static ssize_t queuedBytes_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    return sprintf(buf, "%lld\n", atomic64_read(&queuedBytes));
+}
+
+static ssize_t storedBytes_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    return sprintf(buf, "%lld\n", atomic64_read(&storedBytes));
+}
+
+// Ratio between the queued data and the memory its chunks use, with two decimal places
+static ssize_t ratio_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    s64 queued = atomic64_read(&queuedBytes);
+    s64 stored = atomic64_read(&storedBytes);
+    u64 ratio = 100;
+
+    if (queued > 0 && stored > 0)
+        ratio = div64_u64((u64) queued * 100, stored);
+
+    return sprintf(buf, "%llu.%02llu\n", ratio / 100, ratio % 100);
+}
+
+static ssize_t compressTime_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    return sprintf(buf, "%lld\n", atomic64_read(&compressTime));
+}
+
+static ssize_t decompressTime_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    return sprintf(buf, "%lld\n", atomic64_read(&decompressTime));
+}
+
+static ssize_t numberOpens_show(struct device *dev, struct device_attribute *attr, char *buf) {
+    return sprintf(buf, "%d\n", atomic_read(&numberOpens));
+}
+
+#ifndef EBBCHAR_KUNIT_TEST
+
+static int majorNumber;
+static struct class* ebbcharClass = NULL;
+
+/** @brief LKM initialization function
+ *  Function used at initialization time and is responsable for allocating dynamically
+ *  the major number, registering device class and device driver.
  *  @return returns 0 if successful
  */
-static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, loff_t *offset) {
+static int __init ebbchar_init(void) {
+
+    int ret;
 
-    filep->private_data = (char *) kmalloc(sizeof(char) * len, GFP_KERNEL);
+    printk(KERN_INFO "EBBChar: initializing the EBBChar LKM\n");
+
+    ret = ebbchar_setup();
+    if (ret)
+        return ret;
+
+    // Dynamically allocate a major number for a device
+    majorNumber = register_chrdev(0, DEVICE_NAME, &fops);
+
+    if (majorNumber < 0) {
+        printk(KERN_ALERT "EBBChar: failed to register major number\n");
+        return majorNumber;
+    }
+    printk(KERN_INFO "EBBChar: registered correctly with major number\n");
+
+    // Register the device class
+    ebbcharClass = class_create(THIS_MODULE, CLASS_NAME);
+    if (IS_ERR(ebbcharClass)) {
+        unregister_chrdev(majorNumber, DEVICE_NAME);
+        printk(KERN_ALERT "EBBChar: failed to register device class\n");
+        return PTR_ERR(ebbcharClass);
+    }
+    printk(KERN_INFO "EBBChar: device class registered correctly\n");
+
+    // Register the device driver
+    ebbcharDevice = device_create_with_groups(ebbcharClass, NULL, MKDEV(majorNumber, 0), NULL,
+                                              ebbchar_groups, DEVICE_NAME);
+    if (IS_ERR(ebbcharDevice)) {
+        class_destroy(ebbcharClass);
+        class_unregister(ebbcharClass);
+        unregister_chrdev(majorNumber, DEVICE_NAME);
+        printk(KERN_ALERT "EBBChar: failed to create the device\n");
+        return PTR_ERR(ebbcharDevice);
+    }
+    printk(KERN_INFO "EBBChar: device class created correctly\n");
+
+    if (compress)
+        printk(KERN_INFO "EBBChar: storing data LZ4 compressed in chunks of %zu bytes\n", chunkData);
+
+    return 0;
+
+}
+
+/** @brief LKM cleanup function
+ *  Function responsable for destroying all classes, devices and major number
+ */
+static void __exit ebbchar_exit(void) {
+
+    device_destroy(ebbcharClass,  MKDEV(majorNumber, 0));     // remove the device
+    class_unregister(ebbcharClass);                           // unregister the device class
+    class_destroy(ebbcharClass);                              // remove the device class
+    unregister_chrdev(majorNumber, DEVICE_NAME);              // unregister the major number
+
+    ebbchar_drop_chunks();
+
+    printk(KERN_INFO "EBBChar: Goodbye from the LKM!\n");
 
-    // copy_from_user has the args (*to, *from, size) and returns 0 on success
-    copy_from_user(filep->private_data, buffer, len);
-    printk(KERN_INFO "EBBChar: received %zu characters from the user\n", len);
-    return len;
 }
 
 module_init(ebbchar_init);
 module_exit(ebbchar_exit);
 
+#endif
@@ -0,0 +1,624 @@
+/*
+ * @file char_test.c
+ * @brief KUnit tests and benchmarks for the ebbchar data path
+ *
+ * The tests are built in the same module as the driver, so they reach its static functions and
+ * stats directly. They drive ebbchar_write() and ebbchar_read() with kernel buffers, the same
+ * way dev_write_iter() and dev_read_iter() do with the user ones. As in button_kobject_test,
+ * EBBCHAR_KUNIT_TEST leaves out the module init and exit of the driver: the suites set up the
+ * queues themselves and /dev/ebbchar is not registered, so char.ko may be loaded at the same
+ * time.
+ *
+ * Two suites are registered: ebbchar, with the functional tests, and ebbchar_bench, whose cases
+ * report "bench=<name> key=value ..." lines as KTAP diagnostics.
+ */
+
+#define EBBCHAR_KUNIT_TEST
+#include "char.c"
+
+#include <kunit/test.h>
+#include <linux/random.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+
+#define TEST_RECORD_SIZE 256
+#define TEST_WRITERS     8
+#define TEST_RECORDS     500
+#define BENCH_ITERATIONS 1000
+
+/**
+ * @brief State of each test case, restored when the case ends even if it fails
+ */
+struct ebbchar_test_ctx {
+    struct ebbchar_file *files[4];
+    bool savedCompress;
+    unsigned long savedMaxStored;
+};
+
+// A record written by the concurrent test, small enough to be always read back whole
+struct ebbchar_test_record {
+    u32 writer;
+    u32 seq;
+    char payload[TEST_RECORD_SIZE - 2 * sizeof(u32)];
+};
+
+struct ebbchar_test_writer {
+    struct work_struct work;
+    u32 writer;
+    atomic_t *seen;
+    atomic_t *errors;
+};
+
+static ssize_t test_write(struct ebbchar_file *file, const void *buffer, size_t len) {
+    struct kvec kvec = { .iov_base = (void *) buffer, .iov_len = len };
+    struct iov_iter iter;
+
+    iov_iter_kvec(&iter, WRITE, &kvec, 1, len);
+    return ebbchar_write(file, &iter);
+}
+
+static ssize_t test_read(struct ebbchar_file *file, void *buffer, size_t len) {
+    struct kvec kvec = { .iov_base = buffer, .iov_len = len };
+    struct iov_iter iter;
+
+    iov_iter_kvec(&iter, READ, &kvec, 1, len);
+    return ebbchar_read(file, &iter);
+}
+
+/** @brief Opens a file with the given compress setting, as dev_open() would
+ */
+static struct ebbchar_file *test_open(struct kunit *test, bool isCompressing) {
+    struct ebbchar_test_ctx *ctx = test->priv;
+    struct ebbchar_file *file;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(ctx->files) && ctx->files[i]; i++)
+        ;
+    KUNIT_ASSERT_LT(test, i, (int) ARRAY_SIZE(ctx->files));
+
+    compress = isCompressing;
+    file = ebbchar_alloc_file();
+    compress = ctx->savedCompress;
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, file);
+
+    ctx->files[i] = file;
+    return file;
+}
+
+// Closes a file opened with test_open(), as dev_release() would
+static void test_close(struct kunit *test, struct ebbchar_file *file) {
+    struct ebbchar_test_ctx *ctx = test->priv;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(ctx->files); i++) {
+        if (ctx->files[i] == file) {
+            ctx->files[i] = NULL;
+            ebbchar_free_file(file);
+            return;
+        }
+    }
+    KUNIT_FAIL(test, "closing a file that is not open");
+}
+
+/** @brief Reads and drops everything queued in the device
+ *  @return returns the number of bytes dropped
+ */
+static size_t test_drain(void) {
+    struct ebbchar_file *file;
+    size_t drained = 0;
+    char *buffer;
+    ssize_t ret;
+
+    file = ebbchar_alloc_file();
+    buffer = kmalloc(chunkData, GFP_KERNEL);
+
+    if (file && buffer) {
+        while ((ret = test_read(file, buffer, chunkData)) > 0)
+            drained += ret;
+    }
+
+    kfree(buffer);
+    if (file)
+        ebbchar_free_file(file);
+    return drained;
+}
+
+static int ebbchar_test_suite_init(struct kunit_suite *suite) {
+    return ebbchar_setup();
+}
+
+static void ebbchar_test_suite_exit(struct kunit_suite *suite) {
+    ebbchar_drop_chunks();
+}
+
+static int ebbchar_test_init(struct kunit *test) {
+    struct ebbchar_test_ctx *ctx;
+
+    ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+    if (!ctx)
+        return -ENOMEM;
+
+    ctx->savedCompress = compress;
+    ctx->savedMaxStored = maxStored;
+    test->priv = ctx;
+
+    // Every case starts with an empty queue
+    if (test_drain())
+        kunit_info(test, "dropped data left in the device\n");
+
+    return 0;
+}
+
+static void ebbchar_test_exit(struct kunit *test) {
+    struct ebbchar_test_ctx *ctx = test->priv;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(ctx->files); i++) {
+        if (ctx->files[i])
+            ebbchar_free_file(ctx->files[i]);
+    }
+    test_drain();
+
+    compress = ctx->savedCompress;
+    maxStored = ctx->savedMaxStored;
+}
+
+static void fill_pattern(char *buffer, size_t len, unsigned int seed) {
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        buffer[i] = 'a' + (seed + i) % 26;
+}
+
+// Data written by one file comes back whole and in order, even when it spans several chunks
+static void ebbchar_test_roundtrip(struct kunit *test) {
+    struct ebbchar_file *file = test_open(test, false);
+    size_t len = 3 * chunkData + 10, done = 0;
+    char *in, *out;
+    ssize_t ret;
+
+    in = kunit_kmalloc(test, len, GFP_KERNEL);
+    out = kunit_kzalloc(test, len, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, in);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, out);
+    fill_pattern(in, len, 0);
+
+    KUNIT_ASSERT_EQ(test, test_write(file, in, len), (ssize_t) len);
+    KUNIT_EXPECT_EQ(test, atomic64_read(&queuedBytes), (s64) len);
+
+    // Each read returns at most the rest of one chunk
+    while ((ret = test_read(file, out + done, len - done)) > 0) {
+        KUNIT_EXPECT_LE(test, (size_t) ret, chunkData);
+        done += ret;
+    }
+
+    KUNIT_EXPECT_EQ(test, ret, (ssize_t) 0);
+    KUNIT_ASSERT_EQ(test, done, len);
+    KUNIT_EXPECT_EQ(test, memcmp(in, out, len), 0);
+    KUNIT_EXPECT_EQ(test, atomic64_read(&queuedBytes), 0LL);
+}
+
+// A chunk read with a small buffer is sent in pieces to the same file
+static void ebbchar_test_partial_read(struct kunit *test) {
+    struct ebbchar_file *file = test_open(test, false);
+    char in[100], out[100];
+
+    fill_pattern(in, sizeof(in), 3);
+    KUNIT_ASSERT_EQ(test, test_write(file, in, sizeof(in)), (ssize_t) sizeof(in));
+
+    KUNIT_EXPECT_EQ(test, test_read(file, out, 10), (ssize_t) 10);
+    KUNIT_EXPECT_EQ(test, memcmp(in, out, 10), 0);
+    KUNIT_EXPECT_EQ(test, atomic64_read(&queuedBytes), 90LL);
+
+    KUNIT_EXPECT_EQ(test, test_read(file, out + 10, sizeof(out)), (ssize_t) 90);
+    KUNIT_EXPECT_EQ(test, memcmp(in, out, sizeof(in)), 0);
+
+    KUNIT_EXPECT_EQ(test, test_read(file, out, sizeof(out)), (ssize_t) 0);
+    KUNIT_EXPECT_EQ(test, atomic64_read(&queuedBytes), 0LL);
+}
+
+static void test_partial_release(struct kunit *test, bool isCompressing) {
+    struct ebbchar_file *writer, *first, *second;
+    char in[100], out[100];
+
+    fill_pattern(in, sizeof(in), 5);
+    writer = test_open(test, isCompressing);
+    first = test_open(test, isCompressing);
+    second = test_open(test, isCompressing);
+
+    KUNIT_ASSERT_EQ(test, test_write(writer, in, sizeof(in)), (ssize_t) sizeof(in));
+    KUNIT_ASSERT_EQ(test, test_read(first, out, 10), (ssize_t) 10);
+    test_close(test, first);
+
+    KUNIT_EXPECT_EQ(test, atomic64_read(&queuedBytes), 90LL);
+    KUNIT_EXPECT_EQ(test, test_read(second, out, sizeof(out)), (ssize_t) 90);
+    KUNIT_EXPECT_EQ(test, memcmp(in + 10, out, 90), 0);
+    KUNIT_EXPECT_EQ(test, test_read(second, out, sizeof(out)), (ssize_t) 0);
+
+    test_close(test, writer);
+    test_close(test, second);
+}
+
+// Closing a file in the middle of a chunk hands the rest of it to the next reader
+static void ebbchar_test_partial_release(struct kunit *test) {
+    test_partial_release(test, false);
+    test_partial_release(test, true);
+}
+
+// Whatever way the data leaves the device, the stats go back to where they were
+static void ebbchar_test_leak(struct kunit *test) {
+    s64 queuedBefore = atomic64_read(&queuedBytes);
+    s64 storedBefore = atomic64_read(&storedBytes);
+    struct ebbchar_file *writer, *reader;
+    size_t len = 2 * chunkData + 1;
+    char *buffer;
+
+    buffer = kunit_kmalloc(test, len, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buffer);
+    fill_pattern(buffer, len, 7);
+
+    writer = test_open(test, false);
+    reader = test_open(test, false);
+
+    KUNIT_ASSERT_EQ(test, test_write(writer, buffer, len), (ssize_t) len);
+    KUNIT_EXPECT_EQ(test, atomic64_read(&queuedBytes) - queuedBefore, (s64) len);
+    KUNIT_EXPECT_GE(test, atomic64_read(&storedBytes) - storedBefore, (s64) len);
+
+    // One chunk is fully read, one is left half read by a closed file, one is never read
+    KUNIT_EXPECT_EQ(test, test_read(reader, buffer, chunkData), (ssize_t) chunkData);
+    KUNIT_EXPECT_EQ(test, test_read(reader, buffer, chunkData / 2), (ssize_t) (chunkData / 2));
+    test_close(test, reader);
+    test_close(test, writer);
+
+    KUNIT_EXPECT_EQ(test, atomic64_read(&queuedBytes) - queuedBefore, (s64) (len - chunkData - chunkData / 2));
+    KUNIT_EXPECT_EQ(test, test_drain(), len - chunkData - chunkData / 2);
+
+    KUNIT_EXPECT_EQ(test, atomic64_read(&queuedBytes), queuedBefore);
+    KUNIT_EXPECT_EQ(test, atomic64_read(&storedBytes), storedBefore);
+}
+
+// Compressible data is stored in less memory than it was written with and read back intact
+static void ebbchar_test_compressed(struct kunit *test) {
+    s64 storedBefore = atomic64_read(&storedBytes);
+    s64 compressBefore = atomic64_read(&compressTime);
+    s64 decompressBefore = atomic64_read(&decompressTime);
+    struct ebbchar_file *file = test_open(test, true);
+    char *in, *out;
+
+    in = kunit_kmalloc(test, chunkData, GFP_KERNEL);
+    out = kunit_kzalloc(test, chunkData, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, in);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, out);
+    fill_pattern(in, chunkData, 0);
+
+    KUNIT_ASSERT_EQ(test, test_write(file, in, chunkData), (ssize_t) chunkData);
+    KUNIT_EXPECT_LT(test, atomic64_read(&storedBytes) - storedBefore, (s64) (chunkData / 2));
+    KUNIT_EXPECT_GT(test, atomic64_read(&compressTime), compressBefore);
+
+    KUNIT_EXPECT_EQ(test, test_read(file, out, chunkData), (ssize_t) chunkData);
+    KUNIT_EXPECT_EQ(test, memcmp(in, out, chunkData), 0);
+    KUNIT_EXPECT_GT(test, atomic64_read(&decompressTime), decompressBefore);
+    KUNIT_EXPECT_EQ(test, atomic64_read(&storedBytes), storedBefore);
+}
+
+// A file opened with compress unset reads the chunks another file compressed
+static void ebbchar_test_plain_reader(struct kunit *test) {
+    s64 storedBefore = atomic64_read(&storedBytes);
+    struct ebbchar_file *writer = test_open(test, true);
+    struct ebbchar_file *reader = test_open(test, false);
+    char *in, *out;
+
+    in = kunit_kmalloc(test, chunkData, GFP_KERNEL);
+    out = kunit_kzalloc(test, chunkData, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, in);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, out);
+    fill_pattern(in, chunkData, 0);
+
+    KUNIT_ASSERT_EQ(test, test_write(writer, in, chunkData), (ssize_t) chunkData);
+    KUNIT_EXPECT_LT(test, atomic64_read(&storedBytes) - storedBefore, (s64) (chunkData / 2));
+
+    KUNIT_EXPECT_EQ(test, test_read(reader, out, chunkData), (ssize_t) chunkData);
+    KUNIT_EXPECT_EQ(test, memcmp(in, out, chunkData), 0);
+}
+
+// Data LZ4 can not shrink is stored plain even when compress is set
+static void ebbchar_test_incompressible(struct kunit *test) {
+    s64 storedBefore = atomic64_read(&storedBytes);
+    struct ebbchar_file *file = test_open(test, true);
+    char *in, *out;
+
+    in = kunit_kmalloc(test, chunkData, GFP_KERNEL);
+    out = kunit_kzalloc(test, chunkData, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, in);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, out);
+    get_random_bytes(in, chunkData);
+
+    KUNIT_ASSERT_EQ(test, test_write(file, in, chunkData), (ssize_t) chunkData);
+    KUNIT_EXPECT_GE(test, atomic64_read(&storedBytes) - storedBefore, (s64) chunkData);
+
+    KUNIT_EXPECT_EQ(test, test_read(file, out, chunkData), (ssize_t) chunkData);
+    KUNIT_EXPECT_EQ(test, memcmp(in, out, chunkData), 0);
+}
+
+// Writes stop at maxStored: a write that queues nothing fails with -ENOSPC
+static void ebbchar_test_max_stored(struct kunit *test) {
+    struct ebbchar_file *file = test_open(test, false);
+    size_t len = 4 * chunkData;
+    char *buffer;
+    ssize_t ret;
+
+    buffer = kunit_kmalloc(test, len, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buffer);
+    fill_pattern(buffer, len, 1);
+
+    maxStored = atomic64_read(&storedBytes) + 2 * chunkSize;
+
+    ret = test_write(file, buffer, len);
+    KUNIT_EXPECT_GT(test, ret, (ssize_t) 0);
+    KUNIT_EXPECT_LT(test, ret, (ssize_t) len);
+    KUNIT_EXPECT_LE(test, atomic64_read(&storedBytes), (s64) maxStored);
+
+    KUNIT_EXPECT_EQ(test, test_write(file, buffer, len), (ssize_t) -ENOSPC);
+
+    // Reading frees the room again
+    KUNIT_EXPECT_EQ(test, test_drain(), (size_t) ret);
+    KUNIT_EXPECT_EQ(test, test_write(file, buffer, chunkData), (ssize_t) chunkData);
+}
+
+static void test_check_record(struct ebbchar_test_writer *writer, const char *buffer, ssize_t len) {
+    const struct ebbchar_test_record *rec = (const void *) buffer;
+
+    if (len != sizeof(*rec) || rec->writer >= TEST_WRITERS || rec->seq >= TEST_RECORDS ||
+        memchr_inv(rec->payload, 'a' + (rec->writer + rec->seq) % 26, sizeof(rec->payload))) {
+        atomic_inc(writer->errors);
+        return;
+    }
+
+    atomic_inc(&writer->seen[rec->writer * TEST_RECORDS + rec->seq]);
+}
+
+// Each writer opens its own file, then writes its records and reads whatever is available
+static void test_writer_work(struct work_struct *work) {
+    struct ebbchar_test_writer *writer = container_of(work, struct ebbchar_test_writer, work);
+    struct ebbchar_test_record rec;
+    struct ebbchar_file *file;
+    char *buffer;
+    ssize_t ret;
+    u32 i;
+
+    file = ebbchar_alloc_file();
+    buffer = kmalloc(chunkData, GFP_KERNEL);
+    if (!file || !buffer) {
+        atomic_inc(writer->errors);
+        goto out;
+    }
+
+    for (i = 0; i < TEST_RECORDS; i++) {
+        rec.writer = writer->writer;
+        rec.seq = i;
+        memset(rec.payload, 'a' + (rec.writer + i) % 26, sizeof(rec.payload));
+
+        if (test_write(file, &rec, sizeof(rec)) != sizeof(rec))
+            atomic_inc(writer->errors);
+
+        ret = test_read(file, buffer, chunkData);
+        if (ret < 0)
+            atomic_inc(writer->errors);
+        else if (ret > 0)
+            test_check_record(writer, buffer, ret);
+    }
+
+out:
+    kfree(buffer);
+    if (file)
+        ebbchar_free_file(file);
+}
+
+// Many files write and read at the same time, and every record is received exactly once
+static void ebbchar_test_concurrent_opens(struct kunit *test) {
+    struct ebbchar_test_writer *writers;
+    struct ebbchar_file *reader;
+    struct workqueue_struct *wq;
+    atomic_t *seen, errors = ATOMIC_INIT(0);
+    int missing = 0, duplicated = 0;
+    char *buffer;
+    ssize_t ret;
+    int i;
+
+    if (chunkData < sizeof(struct ebbchar_test_record))
+        kunit_skip(test, "chunkSize too small for the test records");
+
+    maxStored = 0;
+
+    writers = kunit_kcalloc(test, TEST_WRITERS, sizeof(*writers), GFP_KERNEL);
+    seen = kunit_kcalloc(test, TEST_WRITERS * TEST_RECORDS, sizeof(*seen), GFP_KERNEL);
+    buffer = kunit_kmalloc(test, chunkData, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, writers);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, seen);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buffer);
+
+    wq = alloc_workqueue("ebbchar_test", WQ_UNBOUND, TEST_WRITERS);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, wq);
+
+    for (i = 0; i < TEST_WRITERS; i++) {
+        writers[i].writer = i;
+        writers[i].seen = seen;
+        writers[i].errors = &errors;
+        INIT_WORK(&writers[i].work, test_writer_work);
+        queue_work(wq, &writers[i].work);
+    }
+    destroy_workqueue(wq);
+
+    // Receives the records that are still queued
+    reader = test_open(test, compress);
+    while ((ret = test_read(reader, buffer, chunkData)) > 0)
+        test_check_record(&writers[0], buffer, ret);
+
+    for (i = 0; i < TEST_WRITERS * TEST_RECORDS; i++) {
+        if (atomic_read(&seen[i]) == 0) missing++;
+        if (atomic_read(&seen[i]) > 1) duplicated++;
+    }
+
+    KUNIT_EXPECT_EQ(test, atomic_read(&errors), 0);
+    KUNIT_EXPECT_EQ(test, missing, 0);
+    KUNIT_EXPECT_EQ(test, duplicated, 0);
+    KUNIT_EXPECT_EQ(test, atomic64_read(&queuedBytes), 0LL);
+}
+
+// The file operations open a file, queue a write, read it back and release the file
+static void ebbchar_test_fops(struct kunit *test) {
+    static const char in[] = "through the file operations";
+    char out[sizeof(in)] = { 0 };
+    int opens = atomic_read(&numberOpens);
+    struct kvec kvec;
+    struct iov_iter iter;
+    struct kiocb iocb;
+    struct file *filp;
+
+    KUNIT_EXPECT_PTR_EQ(test, fops.owner, THIS_MODULE);
+
+    filp = kunit_kzalloc(test, sizeof(*filp), GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, filp);
+    KUNIT_ASSERT_EQ(test, fops.open(NULL, filp), 0);
+    KUNIT_EXPECT_EQ(test, atomic_read(&numberOpens), opens + 1);
+    init_sync_kiocb(&iocb, filp);
+
+    kvec.iov_base = (void *) in;
+    kvec.iov_len = sizeof(in);
+    iov_iter_kvec(&iter, WRITE, &kvec, 1, sizeof(in));
+    KUNIT_EXPECT_EQ(test, fops.write_iter(&iocb, &iter), (ssize_t) sizeof(in));
+
+    kvec.iov_base = out;
+    kvec.iov_len = sizeof(out);
+    iov_iter_kvec(&iter, READ, &kvec, 1, sizeof(out));
+    KUNIT_EXPECT_EQ(test, fops.read_iter(&iocb, &iter), (ssize_t) sizeof(in));
+    KUNIT_EXPECT_STREQ(test, out, in);
+
+    KUNIT_EXPECT_EQ(test, fops.release(NULL, filp), 0);
+}
+
+// chunkSize must hold the chunk header and fit a kmalloc() allocation
+static void ebbchar_test_chunk_size(struct kunit *test) {
+    unsigned int saved = chunkSize;
+    size_t savedData = chunkData;
+
+    chunkSize = sizeof(struct ebbchar_chunk);
+    KUNIT_EXPECT_EQ(test, ebbchar_check_chunk_size(), -EINVAL);
+    chunkSize = KMALLOC_MAX_SIZE + 1;
+    KUNIT_EXPECT_EQ(test, ebbchar_check_chunk_size(), -EINVAL);
+    KUNIT_EXPECT_EQ(test, chunkData, savedData);
+
+    chunkSize = saved;
+    KUNIT_EXPECT_EQ(test, ebbchar_check_chunk_size(), 0);
+    KUNIT_EXPECT_EQ(test, chunkData, savedData);
+}
+
+static struct kunit_case ebbchar_test_cases[] = {
+    KUNIT_CASE(ebbchar_test_fops),
+    KUNIT_CASE(ebbchar_test_roundtrip),
+    KUNIT_CASE(ebbchar_test_partial_read),
+    KUNIT_CASE(ebbchar_test_partial_release),
+    KUNIT_CASE(ebbchar_test_leak),
+    KUNIT_CASE(ebbchar_test_compressed),
+    KUNIT_CASE(ebbchar_test_plain_reader),
+    KUNIT_CASE(ebbchar_test_incompressible),
+    KUNIT_CASE(ebbchar_test_max_stored),
+    KUNIT_CASE(ebbchar_test_chunk_size),
+    KUNIT_CASE(ebbchar_test_concurrent_opens),
+    {}
+};
+
+static struct kunit_suite ebbchar_test_suite = {
+    .name = "ebbchar",
+    .suite_init = ebbchar_test_suite_init,
+    .suite_exit = ebbchar_test_suite_exit,
+    .init = ebbchar_test_init,
+    .exit = ebbchar_test_exit,
+    .test_cases = ebbchar_test_cases,
+};
+
+/** @brief Times BENCH_ITERATIONS writes of the given size, then as many reads of them
+ */
+static void bench_rw(struct kunit *test, bool isCompressing, size_t size) {
+    struct ebbchar_file *file = test_open(test, isCompressing);
+    ktime_t start;
+    s64 writeTime, readTime;
+    char *buffer;
+    int i;
+
+    buffer = kunit_kmalloc(test, size, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buffer);
+    fill_pattern(buffer, size, 0);
+
+    start = ktime_get();
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+        KUNIT_ASSERT_EQ(test, test_write(file, buffer, size), (ssize_t) size);
+    writeTime = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+    start = ktime_get();
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+        KUNIT_ASSERT_EQ(test, test_read(file, buffer, size), (ssize_t) size);
+    readTime = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+    kunit_info(test, "bench=write compress=%d size=%zu iterations=%d ns_per_op=%lld\n",
+               isCompressing, size, BENCH_ITERATIONS, div_s64(writeTime, BENCH_ITERATIONS));
+    kunit_info(test, "bench=read compress=%d size=%zu iterations=%d ns_per_op=%lld\n",
+               isCompressing, size, BENCH_ITERATIONS, div_s64(readTime, BENCH_ITERATIONS));
+
+    test_close(test, file);
+}
+
+static void ebbchar_bench_rw(struct kunit *test) {
+    size_t sizes[] = { 64, 1024, chunkData };
+    int i;
+
+    maxStored = 0;
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        if (sizes[i] > chunkData)
+            continue;
+        bench_rw(test, false, sizes[i]);
+        bench_rw(test, true, sizes[i]);
+    }
+}
+
+// Times the show functions of the stats, as a read of their sysfs files runs them
+static void ebbchar_bench_sysfs(struct kunit *test) {
+    struct device_attribute *attrs[] = {
+        &dev_attr_queuedBytes, &dev_attr_storedBytes, &dev_attr_ratio,
+    };
+    ktime_t start;
+    s64 elapsed;
+    char *buf;
+    int i, j;
+
+    buf = kunit_kzalloc(test, PAGE_SIZE, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buf);
+
+    for (i = 0; i < ARRAY_SIZE(attrs); i++) {
+        start = ktime_get();
+        for (j = 0; j < BENCH_ITERATIONS; j++)
+            KUNIT_ASSERT_GT(test, attrs[i]->show(ebbcharDevice, attrs[i], buf), (ssize_t) 0);
+        elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+        kunit_info(test, "bench=sysfs attr=%s iterations=%d ns_per_op=%lld\n",
+                   attrs[i]->attr.name, BENCH_ITERATIONS, div_s64(elapsed, BENCH_ITERATIONS));
+    }
+}
+
+static struct kunit_case ebbchar_bench_cases[] = {
+    KUNIT_CASE(ebbchar_bench_rw),
+    KUNIT_CASE(ebbchar_bench_sysfs),
+    {}
+};
+
+static struct kunit_suite ebbchar_bench_suite = {
+    .name = "ebbchar_bench",
+    .suite_init = ebbchar_test_suite_init,
+    .suite_exit = ebbchar_test_suite_exit,
+    .init = ebbchar_test_init,
+    .exit = ebbchar_test_exit,
+    .test_cases = ebbchar_bench_cases,
+};
+
+kunit_test_suites(&ebbchar_test_suite, &ebbchar_bench_suite);
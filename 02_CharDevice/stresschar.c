@@ -0,0 +1,226 @@
+/*
+ * @file stresschar.c
+ * @brief Stress test for the ebbchar device: many threads write and read records
+ * concurrently, then every record is checked to be received exactly once and intact.
+ *
+ * Usage: ./stresschar [threads] [records per thread]
+ *        ./stresschar -s [max threads] [records per thread]
+ * With -s the test is repeated for 1, 2, 4, ... up to max threads, and the throughput of each
+ * run is reported as a "threads=N records_per_sec=R speedup=S" line. It fails if more threads
+ * give less throughput than a single one.
+ * The records are smaller than the module chunk, so each one is read back whole.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#define DEVICE_PATH "/dev/ebbchar"
+#define QUEUED_PATH "/sys/class/ebb/ebbchar/queuedBytes"
+#define RECORD_SIZE 256
+#define READ_SIZE   4096
+
+struct record {
+    uint32_t writer;
+    uint32_t seq;
+    uint32_t checksum;
+    char payload[RECORD_SIZE - 3 * sizeof(uint32_t)];
+};
+
+static int numThreads = 8;
+static int numRecords = 10000;
+static uint8_t *seen = NULL;
+static int corrupted = 0;
+
+static uint32_t checksum(const struct record *rec) {
+    uint32_t sum = rec->writer * 31 + rec->seq;
+    size_t i;
+
+    for (i = 0; i < sizeof(rec->payload); i++)
+        sum = sum * 31 + (uint8_t) rec->payload[i];
+
+    return sum;
+}
+
+static void fill_record(struct record *rec, uint32_t writer, uint32_t seq) {
+    rec->writer = writer;
+    rec->seq = seq;
+    memset(rec->payload, 'a' + (writer + seq) % 26, sizeof(rec->payload));
+    rec->checksum = checksum(rec);
+}
+
+// Checks a record received from the device and marks it as seen
+static void check_record(const char *buffer, ssize_t len) {
+    const struct record *rec = (const struct record *) buffer;
+
+    if (len != RECORD_SIZE || rec->writer >= (uint32_t) numThreads || rec->seq >= (uint32_t) numRecords ||
+        rec->checksum != checksum(rec)) {
+        __atomic_fetch_add(&corrupted, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_fetch_add(&seen[rec->writer * numRecords + rec->seq], 1, __ATOMIC_RELAXED);
+}
+
+static void *stress_thread(void *arg) {
+    uint32_t writer = (uint32_t) (uintptr_t) arg;
+    struct record rec;
+    char buffer[READ_SIZE];
+    ssize_t ret;
+    int fd, i;
+
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open the device");
+        exit(errno);
+    }
+
+    for (i = 0; i < numRecords; i++) {
+        fill_record(&rec, writer, i);
+        ret = write(fd, &rec, sizeof(rec));
+        if (ret != sizeof(rec)) {
+            perror("Failed to write a record to the device");
+            exit(EXIT_FAILURE);
+        }
+
+        // Reads whatever record is available, possibly written by another thread
+        ret = read(fd, buffer, sizeof(buffer));
+        if (ret < 0) {
+            perror("Failed to read a record from the device");
+            exit(EXIT_FAILURE);
+        }
+        if (ret > 0)
+            check_record(buffer, ret);
+    }
+
+    close(fd);
+    return NULL;
+}
+
+static long long read_queued_bytes(void) {
+    long long value = -1;
+    FILE *file = fopen(QUEUED_PATH, "r");
+
+    if (file) {
+        if (fscanf(file, "%lld", &value) != 1)
+            value = -1;
+        fclose(file);
+    }
+
+    return value;
+}
+
+/** @brief Runs the test once with the given number of threads and checks every record
+ *  @param recordsPerSec Receives the throughput of the run
+ *  @return returns 0 if every record was received exactly once and intact
+ */
+static int run_stress(double *recordsPerSec) {
+    pthread_t *threads;
+    struct timespec start, end;
+    char buffer[READ_SIZE];
+    long long queued;
+    int missing = 0, duplicated = 0;
+    double elapsed;
+    ssize_t ret;
+    int fd, i;
+
+    corrupted = 0;
+    seen = calloc((size_t) numThreads * numRecords, sizeof(uint8_t));
+    threads = malloc(sizeof(pthread_t) * numThreads);
+    if (!seen || !threads) {
+        perror("Failed to allocate memory");
+        exit(errno);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numThreads; i++)
+        pthread_create(&threads[i], NULL, stress_thread, (void *) (uintptr_t) i);
+    for (i = 0; i < numThreads; i++)
+        pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // Drains the records that are still queued
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open the device");
+        exit(errno);
+    }
+    while ((ret = read(fd, buffer, sizeof(buffer))) > 0)
+        check_record(buffer, ret);
+    close(fd);
+
+    for (i = 0; i < numThreads * numRecords; i++) {
+        if (seen[i] == 0) missing++;
+        if (seen[i] > 1) duplicated++;
+    }
+
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    *recordsPerSec = numThreads * (double) numRecords / elapsed;
+    queued = read_queued_bytes();
+
+    printf("Elapsed: %.3f s, %.0f records/s\n", elapsed, *recordsPerSec);
+    printf("Missing: %d, duplicated: %d, corrupted: %d, queued bytes left: %lld\n",
+           missing, duplicated, corrupted, queued);
+
+    free(seen);
+    free(threads);
+
+    return missing || duplicated || corrupted || queued > 0;
+}
+
+int main(int argc, char **argv) {
+    double recordsPerSec, singleThread = 0;
+    int maxThreads, scaling = 0, failed = 0;
+
+    if (argc > 1 && !strcmp(argv[1], "-s")) {
+        scaling = 1;
+        argv++;
+        argc--;
+    }
+
+    if (argc > 1) numThreads = atoi(argv[1]);
+    if (argc > 2) numRecords = atoi(argv[2]);
+    if (numThreads <= 0 || numRecords <= 0) {
+        fprintf(stderr, "Usage: %s [-s] [threads] [records per thread]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!scaling) {
+        printf("Stressing %s with %d threads, %d records each.\n", DEVICE_PATH, numThreads, numRecords);
+        failed = run_stress(&recordsPerSec);
+        printf("%s\n", failed ? "FAIL" : "PASS");
+        return failed ? EXIT_FAILURE : 0;
+    }
+
+    maxThreads = numThreads;
+    numThreads = 1;
+    while (numThreads) {
+        printf("Stressing %s with %d threads, %d records each.\n", DEVICE_PATH, numThreads, numRecords);
+        failed |= run_stress(&recordsPerSec);
+
+        if (numThreads == 1)
+            singleThread = recordsPerSec;
+        printf("threads=%d records_per_sec=%.0f speedup=%.2f\n", numThreads, recordsPerSec,
+               recordsPerSec / singleThread);
+
+        // Adding threads must never make the device slower than a single opener
+        if (recordsPerSec < singleThread)
+            failed = 1;
+
+        // Doubles the threads up to maxThreads, which is always the last run
+        if (numThreads == maxThreads)
+            numThreads = 0;
+        else
+            numThreads = numThreads * 2 < maxThreads ? numThreads * 2 : maxThreads;
+    }
+
+    printf("%s\n", failed ? "FAIL" : "PASS");
+    return failed ? EXIT_FAILURE : 0;
+
+}
@@ -10,13 +10,19 @@
 #include <linux/kernel.h>
 #include <linux/gpio.h>
 #include <linux/interrupt.h>
+#include <linux/irq.h>
 #include <linux/kobject.h>
 #include <linux/device.h>
 #include <linux/ktime.h>
 #include <linux/sysfs.h>
+#include <linux/workqueue.h>
+#include <linux/delay.h>
+#include <linux/math64.h>
 
 #define DEBOUNCE 200
 #define RW_MODE  0664
+#define THROTTLE_WINDOW_MS 100
+#define THROTTLE_SAMPLE_US 200
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Maíra Canal");
@@ -31,10 +37,18 @@ static unsigned int gpioButton = 49;
 module_param(gpioButton, uint, S_IRUGO);
 MODULE_PARM_DESC(gpioButton, "GPIO Button number (default = 49)");
 
-static unsigned int gpioLED = 115;
+static unsigned int gpioLed = 115;
 module_param(gpioLed, uint, S_IRUGO);
 MODULE_PARM_DESC(gpioLed, "GPIO LED number (default = 115)");
 
+static unsigned int maxEdgeRate = 1000;
+module_param(maxEdgeRate, uint, S_IRUGO);
+MODULE_PARM_DESC(maxEdgeRate, "Maximum edges per second before the IRQ is masked, 0 = no limit (default = 1000)");
+
+static unsigned int throttleTime = 100;
+module_param(throttleTime, uint, S_IRUGO);
+MODULE_PARM_DESC(throttleTime, "Time in ms the IRQ stays masked when throttled (default = 100)");
+
 static char gpioName[8];
 static unsigned int irqNum;
 static unsigned int numberPresses = 0;
@@ -42,6 +56,14 @@ static bool ledValue = 0;
 static unsigned int isDebounce = 1;
 static ktime_t t_last, t_current, t_diff;
 
+// Throttle state: edges are counted in windows of THROTTLE_WINDOW_MS
+static ktime_t windowStart;
+static unsigned int windowEdges = 0;
+static bool isThrottled = 0;
+static unsigned int throttleCount = 0;
+static unsigned int coalescedEdges = 0;
+static struct work_struct throttleWork;
+
 // ******************************************************************************************* Functions prototypes
 
 /*  
@@ -54,6 +76,23 @@ static ktime_t t_last, t_current, t_diff;
 
 static irq_handler_t gpio_irq_handler(unsigned int irq, void *dev_id, struct pt_regs *regs);
 
+/*  
+ *  @brief Toggles the LED in the IRQ thread, so the GPIO may sleep
+ *  @param irq The interrupt number
+ *  @param dev_id The dev_id registered at request_threaded_irq() 
+ *  @return returns IRQ_HANDLED
+ */
+
+static irqreturn_t gpio_irq_thread(int irq, void *dev_id);
+
+/*  
+ *  @brief Samples the button line while the IRQ is masked, counting the edges into
+ *  coalescedEdges, and unmasks the IRQ when the throttle time is over
+ *  @param work The throttle work
+ */
+
+static void throttle_work_handler(struct work_struct *work);
+
 /*  
  *  @brief Shows the number of presses at sysfs
  *  @param kobj Kobject associated to the function
@@ -124,6 +163,56 @@ static ssize_t isDebounce_show(struct kobject *kobj, struct kobj_attribute *attr
 
 static ssize_t isDebounce_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
 
+/*  
+ *  @brief Shows the maximum edge rate in sysfs
+ *  @param kobj Kobject associated to the function
+ *  @param attr Struct kobj_attribute associated to the function
+ *  @param buf Buffer from sysfs
+ *  @return returns the size of what was written in buffer 
+ */
+
+static ssize_t maxEdgeRate_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
+
+/*  
+ *  @brief Stores the maximum edge rate in sysfs, 0 disables the throttling
+ *  @param kobj Kobject associated to the function
+ *  @param attr Struct kobj_attribute associated to the function
+ *  @param buf Buffer from sysfs
+ *  @return returns the size of what was read in buffer 
+ */
+
+static ssize_t maxEdgeRate_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count);
+
+/*  
+ *  @brief Shows whether the IRQ is masked by the throttling
+ *  @param kobj Kobject associated to the function
+ *  @param attr Struct kobj_attribute associated to the function
+ *  @param buf Buffer from sysfs
+ *  @return returns the size of what was written in buffer 
+ */
+
+static ssize_t isThrottled_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
+
+/*  
+ *  @brief Shows how many times the IRQ was masked by the throttling
+ *  @param kobj Kobject associated to the function
+ *  @param attr Struct kobj_attribute associated to the function
+ *  @param buf Buffer from sysfs
+ *  @return returns the size of what was written in buffer 
+ */
+
+static ssize_t throttleCount_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
+
+/*  
+ *  @brief Shows the number of edges that did not run the full handler while throttling
+ *  @param kobj Kobject associated to the function
+ *  @param attr Struct kobj_attribute associated to the function
+ *  @param buf Buffer from sysfs
+ *  @return returns the size of what was written in buffer 
+ */
+
+static ssize_t coalescedEdges_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf);
+
 // ****************************************************************************************************************
 
 // Using helper macros to define the name and access levels of the kobj_attributes
@@ -132,9 +221,14 @@ static struct kobj_attribute debounce_attr = __ATTR(isDebounce, RW_MODE, isDebou
 static struct kobj_attribute led_attr = __ATTR(ledValue, S_IRUGO, ledValue_show, NULL);
 static struct kobj_attribute time_attr = __ATTR(lastTime, S_IRUGO, lastTime_show, NULL);
 static struct kobj_attribute diff_attr = __ATTR(diffTime, S_IRUGO, diffTime_show, NULL);
+static struct kobj_attribute rate_attr = __ATTR(maxEdgeRate, RW_MODE, maxEdgeRate_show, maxEdgeRate_store);
+static struct kobj_attribute throttled_attr = __ATTR(isThrottled, S_IRUGO, isThrottled_show, NULL);
+static struct kobj_attribute throttle_count_attr = __ATTR(throttleCount, S_IRUGO, throttleCount_show, NULL);
+static struct kobj_attribute coalesced_attr = __ATTR(coalescedEdges, S_IRUGO, coalescedEdges_show, NULL);
 
 // Array of attributes to create a group of attributes
-static struct attribute *attrs[] = {&count_attr.attr, &debounce_attr.attr, &led_attr.attr, &time_attr.attr, &diff_attr.attr, NULL};
+static struct attribute *attrs[] = {&count_attr.attr, &debounce_attr.attr, &led_attr.attr, &time_attr.attr, &diff_attr.attr,
+                                    &rate_attr.attr, &throttled_attr.attr, &throttle_count_attr.attr, &coalesced_attr.attr, NULL};
 
 // This attribute array and name will be exposed on sysfs
 static struct attribute_group attr_group = {
@@ -144,7 +238,13 @@ static struct attribute_group attr_group = {
 
 static struct kobject *gpio_kobj;
 
-static int __init button_init(void) {
+/*  
+ *  @brief Creates the sysfs group, requests the GPIOs and the IRQ. Kept apart from button_init
+ *  so the KUnit suite can run it once the simulated GPIOs exist.
+ *  @return returns 0 if successful
+ */
+
+static int button_setup(void) {
 
     int result = 0;
     unsigned long IRQflag = IRQF_TRIGGER_RISING;
@@ -170,6 +270,9 @@ static int __init button_init(void) {
     // Instantiating the time instances
     t_last = ktime_get_real();
     t_diff = ktime_sub(t_last, t_last);
+    windowStart = ktime_get();
+
+    INIT_WORK(&throttleWork, throttle_work_handler);
 
     // Requesting the LED gpio pin and setting it to output
     gpio_request(gpioLed, "sysfs");
@@ -186,16 +289,33 @@ static int __init button_init(void) {
     irqNum = gpio_to_irq(gpioButton);
     printk(KERN_INFO "BUTTON: the button is mapped to IRQ: %d\n", irqNum);
 
+    // The throttling needs the hard handler, which a nested threaded IRQ never runs
+    if (irq_check_status_bit(irqNum, IRQ_NESTED_THREAD)) {
+        printk(KERN_ALERT "BUTTON: the button IRQ is nested in its controller's thread\n");
+        result = -EINVAL;
+        goto fail_irq;
+    }
+
     if (!isRising) IRQflag = IRQF_TRIGGER_FALLING;
 
-    // Requesting interrupt
-    result = request_irq(irqNum, (irq_handler_t) gpio_irq_handler, IRQflag, "button_handler", NULL);
+    // Requesting interrupt: the handler does the accounting and the thread drives the LED
+    result = request_threaded_irq(irqNum, (irq_handler_t) gpio_irq_handler, gpio_irq_thread, IRQflag, "button_handler", NULL);
+    if (result)
+        goto fail_irq;
 
+    return 0;
+
+fail_irq:
+    gpio_unexport(gpioButton);
+    gpio_unexport(gpioLed);
+    gpio_free(gpioButton);
+    gpio_free(gpioLed);
+    kobject_put(gpio_kobj);
     return result;
 
 }
 
-static void __exit button_exit(void) {
+static void button_teardown(void) {
 
     printk(KERN_INFO "BUTTON: the button was pressed %d times\n", numberPresses);
 
@@ -203,10 +323,13 @@ static void __exit button_exit(void) {
     kobject_put(gpio_kobj);
 
     // Turn LED off
-    gpio_set_value(gpioLed, 0);
+    gpio_set_value_cansleep(gpioLed, 0);
 
     // Freeing gpio and interrupt 
     gpio_unexport(gpioLed);
+    disable_irq(irqNum);
+    if (cancel_work_sync(&throttleWork))
+        enable_irq(irqNum);     // balances the disable of a pending throttle
     free_irq(irqNum, NULL);
     gpio_unexport(gpioButton);
     gpio_free(gpioLed);
@@ -216,11 +339,50 @@ static void __exit button_exit(void) {
 
 }
 
+/*  
+ *  @brief Counts the edge in the current window and masks the IRQ when the window budget is
+ *  exceeded. The edge over the budget is counted in coalescedEdges, and the throttle work
+ *  counts the ones that arrive while the IRQ is masked. The IRQ core may still replay the last
+ *  of them when the IRQ is unmasked, and that one also runs the full handler.
+ *  @return returns true if the edge must not run the full handler
+ */
+
+static bool button_throttle(void) {
+
+    ktime_t now = ktime_get();
+    unsigned int rate = READ_ONCE(maxEdgeRate);
+    u64 budget;
+
+    if (!rate)
+        return false;
+
+    // Computed in 64 bits, so a huge limit does not wrap into a tiny budget
+    budget = max_t(u64, 1, div_u64((u64) rate * THROTTLE_WINDOW_MS, 1000));
+
+    if (ktime_ms_delta(now, windowStart) >= THROTTLE_WINDOW_MS) {
+        windowStart = now;
+        windowEdges = 0;
+    }
+
+    if (++windowEdges <= budget)
+        return false;
+
+    coalescedEdges++;
+    if (!isThrottled) {
+        isThrottled = 1;
+        throttleCount++;
+        disable_irq_nosync(irqNum);
+        queue_work(system_highpri_wq, &throttleWork);
+    }
+
+    return true;
+
+}
+
 static irq_handler_t gpio_irq_handler(unsigned int irq, void *dev_id, struct pt_regs *regs) {
 
-    // Toggle LED
-   ledValue = !ledValue;
-   gpio_set_value(gpioLed, ledValue);
+   if (button_throttle())
+       return (irq_handler_t) IRQ_HANDLED;
 
    // Time log
    t_current = ktime_get_real();
@@ -228,7 +390,39 @@ static irq_handler_t gpio_irq_handler(unsigned int irq, void *dev_id, struct pt_
    t_last = t_current;
    numberPresses++;
 
-   return (irq_handler_t) IRQ_HANDLED;
+   return (irq_handler_t) IRQ_WAKE_THREAD;
+
+}
+
+static irqreturn_t gpio_irq_thread(int irq, void *dev_id) {
+
+    // Toggle LED
+    ledValue = !ledValue;
+    gpio_set_value_cansleep(gpioLed, ledValue);
+
+    return IRQ_HANDLED;
+
+}
+
+static void throttle_work_handler(struct work_struct *work) {
+
+    ktime_t end = ktime_add_ms(ktime_get(), throttleTime);
+    bool last = gpio_get_value_cansleep(gpioButton) > 0;
+    bool level;
+
+    // Process context: the button line may be read from a controller that sleeps
+    while (ktime_before(ktime_get(), end)) {
+        usleep_range(THROTTLE_SAMPLE_US, 2 * THROTTLE_SAMPLE_US);
+        level = gpio_get_value_cansleep(gpioButton) > 0;
+        if (level != last && level == isRising)
+            coalescedEdges++;
+        last = level;
+    }
+
+    windowStart = ktime_get();
+    windowEdges = 0;
+    isThrottled = 0;
+    enable_irq(irqNum);
 
 }
 
@@ -271,5 +465,45 @@ static ssize_t isDebounce_store(struct kobject *kobj, struct kobj_attribute *att
     return count;
 }
 
+static ssize_t maxEdgeRate_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    return sprintf(buf, "%u\n", maxEdgeRate);
+}
+
+static ssize_t maxEdgeRate_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    unsigned int rate;
+    int result = kstrtouint(buf, 10, &rate);
+
+    if (result)
+        return result;
+
+    WRITE_ONCE(maxEdgeRate, rate);
+    printk(KERN_INFO "BUTTON: maximum edge rate set to %u edges/s\n", maxEdgeRate);
+    return count;
+}
+
+static ssize_t isThrottled_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    return sprintf(buf, "%d\n", isThrottled);
+}
+
+static ssize_t throttleCount_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    return sprintf(buf, "%u\n", throttleCount);
+}
+
+static ssize_t coalescedEdges_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    return sprintf(buf, "%u\n", coalescedEdges);
+}
+
+#ifndef BUTTON_KUNIT_TEST
+
+static int __init button_init(void) {
+    return button_setup();
+}
+
+static void __exit button_exit(void) {
+    button_teardown();
+}
+
 module_init(button_init);
 module_exit(button_exit);
+
+#endif
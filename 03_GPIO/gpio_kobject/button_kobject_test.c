@@ -0,0 +1,416 @@
+/*
+ * @file button_kobject_test.c
+ * @brief KUnit tests and benchmarks for button_kobject on a simulated GPIO chip
+ *
+ * The suite registers a gpio-sim chip with two lines, the button and the LED, through software
+ * nodes, and sets the module up on them. Edges are injected by marking the button IRQ pending on
+ * the irq_sim chip behind gpio-sim, so the module handles them as it would a real button. The
+ * throttle case drives the line itself through the sim_gpio0/pull attribute of the chip, as the
+ * throttle work only sees the edges that change the line. The kernel needs CONFIG_GPIO_SIM;
+ * without it every case is skipped.
+ *
+ * Two suites are registered: button_kobject, with the functional tests, and
+ * button_kobject_bench, whose cases report "bench=<name> key=value ..." lines as KTAP
+ * diagnostics.
+ */
+
+#define BUTTON_KUNIT_TEST
+#include "button_kobject.c"
+
+#include <kunit/test.h>
+#include <linux/delay.h>
+#include <linux/fs.h>
+#include <linux/gpio/driver.h>
+#include <linux/kmod.h>
+#include <linux/platform_device.h>
+#include <linux/property.h>
+
+#define TEST_LABEL       "button-kunit"
+#define TEST_EDGES       20
+#define TEST_TIMEOUT_MS  1000
+#define TEST_PULSES      5
+#define TEST_PULSE_US    5000
+#define BENCH_ITERATIONS 1000
+
+static const struct property_entry bank_props[] = {
+    PROPERTY_ENTRY_U32("ngpios", 2),
+    PROPERTY_ENTRY_STRING("gpio-sim,label", TEST_LABEL),
+    { }
+};
+
+static const struct software_node chip_node = {
+    .name = TEST_LABEL,
+};
+
+static const struct software_node bank_node = {
+    .name = "bank0",
+    .parent = &chip_node,
+    .properties = bank_props,
+};
+
+static const struct software_node *sim_nodes[] = { &chip_node, &bank_node, NULL };
+
+static struct platform_device *simDevice;
+static char *pullPath;
+static bool isSetUp = 0;
+
+static int test_match_label(struct gpio_chip *gc, void *data) {
+    return gc->label && !strcmp(gc->label, data);
+}
+
+static int test_match_gpiochip(struct device *dev, void *data) {
+    return !strncmp(dev_name(dev), "gpiochip", 8);
+}
+
+/*
+ *  @brief Builds the path of the pull attribute of the button line, which gpio-sim exposes in
+ *  the gpiochip device under the platform device
+ *  @return returns the path, or NULL if it was not found
+ */
+
+static char *test_find_pull(void) {
+
+    struct device *chipDevice;
+    char *chipPath, *path = NULL;
+
+    chipDevice = device_find_child(&simDevice->dev, NULL, test_match_gpiochip);
+    if (!chipDevice)
+        return NULL;
+
+    chipPath = kobject_get_path(&chipDevice->kobj, GFP_KERNEL);
+    if (chipPath)
+        path = kasprintf(GFP_KERNEL, "/sys%s/sim_gpio0/pull", chipPath);
+
+    kfree(chipPath);
+    put_device(chipDevice);
+    return path;
+
+}
+
+/*
+ *  @brief Creates the gpio-sim chip and sets the module up on its lines: the button is line 0
+ *  and the LED is line 1
+ *  @return returns 0, the cases are skipped if the chip can not be created
+ */
+
+static int button_test_suite_init(struct kunit_suite *suite) {
+
+    struct platform_device_info info = {
+        .name = "gpio-sim",
+        .id = PLATFORM_DEVID_AUTO,
+    };
+    struct gpio_chip *gc;
+
+    request_module("gpio-sim");
+
+    if (software_node_register_node_group(sim_nodes)) {
+        printk(KERN_ALERT "BUTTON: failed to register the gpio-sim nodes\n");
+        return 0;
+    }
+
+    info.fwnode = software_node_fwnode(&chip_node);
+    simDevice = platform_device_register_full(&info);
+    if (IS_ERR(simDevice))
+        goto fail_device;
+
+    gc = gpiochip_find((void *) TEST_LABEL, test_match_label);
+    if (!gc) {
+        printk(KERN_ALERT "BUTTON: gpio-sim is not available\n");
+        goto fail_chip;
+    }
+
+    gpioButton = gc->base;
+    gpioLed = gc->base + 1;
+    if (button_setup()) {
+        printk(KERN_ALERT "BUTTON: failed to set up on the gpio-sim chip\n");
+        goto fail_chip;
+    }
+
+    pullPath = test_find_pull();
+    isSetUp = 1;
+    return 0;
+
+fail_chip:
+    platform_device_unregister(simDevice);
+fail_device:
+    simDevice = NULL;
+    software_node_unregister_node_group(sim_nodes);
+    return 0;
+
+}
+
+static void button_test_suite_exit(struct kunit_suite *suite) {
+
+    if (!isSetUp)
+        return;
+
+    button_teardown();
+    kfree(pullPath);
+    pullPath = NULL;
+    platform_device_unregister(simDevice);
+    software_node_unregister_node_group(sim_nodes);
+    isSetUp = 0;
+
+}
+
+/*
+ *  @brief Waits for a counter updated by the IRQ handler to reach a value
+ *  @return returns true if it did before TEST_TIMEOUT_MS
+ */
+
+static bool test_wait_for(unsigned int *counter, unsigned int value) {
+
+    int i;
+
+    for (i = 0; i < TEST_TIMEOUT_MS; i++) {
+        if (READ_ONCE(*counter) >= value)
+            return true;
+        usleep_range(1000, 2000);
+    }
+
+    return READ_ONCE(*counter) >= value;
+
+}
+
+// Raises an edge on the button line, as gpio-sim does when its pull changes
+static int test_inject_edge(void) {
+    return irq_set_irqchip_state(irqNum, IRQCHIP_STATE_PENDING, true);
+}
+
+// Pulls the button line up or down, which raises an edge when it matches the trigger
+static int test_set_pull(const char *pull) {
+
+    struct file *file;
+    loff_t pos = 0;
+    ssize_t result;
+
+    file = filp_open(pullPath, O_WRONLY, 0);
+    if (IS_ERR(file))
+        return PTR_ERR(file);
+
+    result = kernel_write(file, pull, strlen(pull), &pos);
+    filp_close(file, NULL);
+
+    return result < 0 ? result : 0;
+
+}
+
+// Every case starts unthrottled, with the counters cleared and the module defaults
+static int button_test_init(struct kunit *test) {
+
+    if (!isSetUp)
+        kunit_skip(test, "gpio-sim is not available");
+
+    WRITE_ONCE(maxEdgeRate, 1000);
+    throttleTime = 100;
+    msleep(throttleTime + THROTTLE_WINDOW_MS);
+    KUNIT_ASSERT_FALSE(test, READ_ONCE(isThrottled));
+    synchronize_irq(irqNum);
+
+    numberPresses = 0;
+    throttleCount = 0;
+    coalescedEdges = 0;
+
+    return 0;
+
+}
+
+// With no limit every edge is counted and toggles the LED
+static void button_test_edge_count(struct kunit *test) {
+
+    bool startValue = ledValue;
+    int i;
+
+    WRITE_ONCE(maxEdgeRate, 0);
+
+    for (i = 0; i < TEST_EDGES; i++) {
+        KUNIT_ASSERT_EQ(test, test_inject_edge(), 0);
+        KUNIT_ASSERT_TRUE(test, test_wait_for(&numberPresses, i + 1));
+    }
+
+    // Lets the IRQ thread finish toggling the LED
+    synchronize_irq(irqNum);
+
+    KUNIT_EXPECT_EQ(test, numberPresses, (unsigned int) TEST_EDGES);
+    KUNIT_EXPECT_EQ(test, ledValue, (bool) (startValue ^ (TEST_EDGES & 1)));
+    KUNIT_EXPECT_EQ(test, gpio_get_value_cansleep(gpioLed), (int) ledValue);
+    KUNIT_EXPECT_EQ(test, throttleCount, 0U);
+    KUNIT_EXPECT_EQ(test, coalescedEdges, 0U);
+
+}
+
+// Edges over the budget of a window mask the IRQ until throttleTime is over
+static void button_test_throttle(struct kunit *test) {
+
+    unsigned int presses;
+    int i;
+
+    if (!pullPath)
+        kunit_skip(test, "the gpio-sim pull attribute was not found");
+
+    // 10 edges/s allow a single edge per window, and the pulses below fit in the throttle time
+    WRITE_ONCE(maxEdgeRate, 10);
+    throttleTime = 500;
+
+    // The line idles low, and every rise is an edge
+    KUNIT_ASSERT_EQ(test, test_set_pull("pull-down"), 0);
+    KUNIT_ASSERT_EQ(test, test_set_pull("pull-up"), 0);
+    KUNIT_ASSERT_TRUE(test, test_wait_for(&numberPresses, 1));
+
+    KUNIT_ASSERT_EQ(test, test_set_pull("pull-down"), 0);
+    KUNIT_ASSERT_EQ(test, test_set_pull("pull-up"), 0);
+    KUNIT_ASSERT_TRUE(test, test_wait_for(&coalescedEdges, 1));
+    KUNIT_EXPECT_TRUE(test, READ_ONCE(isThrottled));
+    KUNIT_EXPECT_EQ(test, throttleCount, 1U);
+    KUNIT_EXPECT_EQ(test, numberPresses, 1U);
+
+    // Lets the throttle work take its first sample, then pulses the masked line
+    usleep_range(TEST_PULSE_US, 2 * TEST_PULSE_US);
+    for (i = 0; i < TEST_PULSES; i++) {
+        KUNIT_ASSERT_EQ(test, test_set_pull("pull-down"), 0);
+        usleep_range(TEST_PULSE_US, 2 * TEST_PULSE_US);
+        KUNIT_ASSERT_EQ(test, test_set_pull("pull-up"), 0);
+        usleep_range(TEST_PULSE_US, 2 * TEST_PULSE_US);
+    }
+    KUNIT_ASSERT_EQ(test, test_set_pull("pull-down"), 0);
+
+    // Waits for the unmask and for the window of a replayed edge to end
+    msleep(throttleTime + 2 * THROTTLE_WINDOW_MS);
+    synchronize_irq(irqNum);
+
+    // The edge over the budget and every masked pulse are counted, and one may be replayed
+    presses = READ_ONCE(numberPresses);
+    KUNIT_EXPECT_FALSE(test, READ_ONCE(isThrottled));
+    KUNIT_EXPECT_LE(test, presses, 2U);
+    KUNIT_EXPECT_EQ(test, coalescedEdges, 1U + TEST_PULSES);
+
+    // Once the throttle is over, edges are handled again
+    KUNIT_ASSERT_EQ(test, test_inject_edge(), 0);
+    KUNIT_EXPECT_TRUE(test, test_wait_for(&numberPresses, presses + 1));
+
+}
+
+// A rate too high for a 32-bit budget must not wrap into a tiny one
+static void button_test_huge_rate(struct kunit *test) {
+
+    int i;
+
+    WRITE_ONCE(maxEdgeRate, UINT_MAX);
+
+    for (i = 0; i < TEST_EDGES; i++) {
+        KUNIT_ASSERT_EQ(test, test_inject_edge(), 0);
+        KUNIT_ASSERT_TRUE(test, test_wait_for(&numberPresses, i + 1));
+    }
+
+    KUNIT_EXPECT_EQ(test, throttleCount, 0U);
+
+}
+
+// maxEdgeRate only takes a number, and keeps its value on errors
+static void button_test_rate_store(struct kunit *test) {
+
+    KUNIT_EXPECT_EQ(test, maxEdgeRate_store(gpio_kobj, &rate_attr, "500\n", 4), (ssize_t) 4);
+    KUNIT_EXPECT_EQ(test, maxEdgeRate, 500U);
+
+    KUNIT_EXPECT_EQ(test, maxEdgeRate_store(gpio_kobj, &rate_attr, "-1\n", 3), (ssize_t) -EINVAL);
+    KUNIT_EXPECT_EQ(test, maxEdgeRate_store(gpio_kobj, &rate_attr, "abc\n", 4), (ssize_t) -EINVAL);
+    KUNIT_EXPECT_EQ(test, maxEdgeRate, 500U);
+
+}
+
+static struct kunit_case button_test_cases[] = {
+    KUNIT_CASE(button_test_edge_count),
+    KUNIT_CASE(button_test_throttle),
+    KUNIT_CASE(button_test_huge_rate),
+    KUNIT_CASE(button_test_rate_store),
+    {}
+};
+
+static struct kunit_suite button_test_suite = {
+    .name = "button_kobject",
+    .suite_init = button_test_suite_init,
+    .suite_exit = button_test_suite_exit,
+    .init = button_test_init,
+    .test_cases = button_test_cases,
+};
+
+// Times from marking the IRQ pending to the handler counting the edge
+static void button_bench_irq(struct kunit *test) {
+
+    s64 elapsed, total = 0, worst = 0;
+    ktime_t start;
+    int i;
+
+    WRITE_ONCE(maxEdgeRate, 0);
+
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        start = ktime_get();
+        KUNIT_ASSERT_EQ(test, test_inject_edge(), 0);
+        while (READ_ONCE(numberPresses) <= i) {
+            KUNIT_ASSERT_LE_MSG(test, ktime_ms_delta(ktime_get(), start), (s64) TEST_TIMEOUT_MS,
+                                "edge %d was not handled", i);
+            cpu_relax();
+        }
+        elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+        total += elapsed;
+        worst = max(worst, elapsed);
+    }
+    synchronize_irq(irqNum);
+
+    kunit_info(test, "bench=irq iterations=%d ns_per_op=%lld max_ns=%lld\n",
+               BENCH_ITERATIONS, div_s64(total, BENCH_ITERATIONS), worst);
+
+}
+
+// Times the show and store functions, as a read or write of their sysfs files runs them
+static void button_bench_sysfs(struct kunit *test) {
+
+    struct kobj_attribute *attrs[] = { &count_attr, &rate_attr, &coalesced_attr };
+    ktime_t start;
+    s64 elapsed;
+    char *buf;
+    int i, j;
+
+    buf = kunit_kzalloc(test, PAGE_SIZE, GFP_KERNEL);
+    KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buf);
+
+    for (i = 0; i < ARRAY_SIZE(attrs); i++) {
+        start = ktime_get();
+        for (j = 0; j < BENCH_ITERATIONS; j++)
+            KUNIT_ASSERT_GT(test, attrs[i]->show(gpio_kobj, attrs[i], buf), (ssize_t) 0);
+        elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+        kunit_info(test, "bench=sysfs attr=%s op=show iterations=%d ns_per_op=%lld\n",
+                   attrs[i]->attr.name, BENCH_ITERATIONS, div_s64(elapsed, BENCH_ITERATIONS));
+
+        if (!attrs[i]->store)
+            continue;
+
+        // Writes back the value just shown
+        start = ktime_get();
+        for (j = 0; j < BENCH_ITERATIONS; j++)
+            KUNIT_ASSERT_GT(test, attrs[i]->store(gpio_kobj, attrs[i], buf, strlen(buf)), (ssize_t) 0);
+        elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+        kunit_info(test, "bench=sysfs attr=%s op=store iterations=%d ns_per_op=%lld\n",
+                   attrs[i]->attr.name, BENCH_ITERATIONS, div_s64(elapsed, BENCH_ITERATIONS));
+    }
+
+}
+
+static struct kunit_case button_bench_cases[] = {
+    KUNIT_CASE(button_bench_irq),
+    KUNIT_CASE(button_bench_sysfs),
+    {}
+};
+
+static struct kunit_suite button_bench_suite = {
+    .name = "button_kobject_bench",
+    .suite_init = button_test_suite_init,
+    .suite_exit = button_test_suite_exit,
+    .init = button_test_init,
+    .test_cases = button_bench_cases,
+};
+
+kunit_test_suites(&button_test_suite, &button_bench_suite);
@@ -0,0 +1,83 @@
+#!/bin/sh
+#
+# @file stress_gpiosim.sh
+# @brief Drives an edge storm into button_kobject through a gpio-sim line and checks
+# that the system stays responsive while the IRQ is throttled.
+#
+# Usage: sudo ./stress_gpiosim.sh [seconds] [maxEdgeRate] [togglers]
+# Needs CONFIG_GPIO_SIM, CONFIG_GPIO_SYSFS and configfs mounted at /sys/kernel/config.
+
+DURATION=${1:-10}
+RATE=${2:-1000}
+TOGGLERS=${3:-$(nproc)}
+MAX_LATENCY_MS=100
+
+SIM=/sys/kernel/config/gpio-sim/button-stress
+LABEL=button-stress
+
+cleanup() {
+    for pid in $PIDS; do kill "$pid" 2>/dev/null; done
+    wait 2>/dev/null
+    rmmod button_kobject 2>/dev/null
+    if [ -d "$SIM" ]; then
+        echo 0 > "$SIM/live"
+        rmdir "$SIM/bank0" "$SIM" 2>/dev/null
+    fi
+}
+trap cleanup EXIT INT TERM
+
+modprobe gpio-sim || exit 1
+
+# Creates a simulated chip with two lines: the button and the LED
+mkdir -p "$SIM/bank0"
+echo 2 > "$SIM/bank0/num_lines"
+echo "$LABEL" > "$SIM/bank0/label"
+echo 1 > "$SIM/live" || exit 1
+
+PULL=/sys/devices/platform/$(cat "$SIM/dev_name")/$(cat "$SIM/bank0/chip_name")/sim_gpio0/pull
+
+for chip in /sys/class/gpio/gpiochip*; do
+    if [ "$(cat "$chip/label")" = "$LABEL" ]; then
+        BASE=$(cat "$chip/base")
+    fi
+done
+if [ -z "$BASE" ]; then
+    echo "Failed to find the gpio-sim chip in /sys/class/gpio"
+    exit 1
+fi
+
+insmod button_kobject.ko gpioButton="$BASE" gpioLed=$((BASE + 1)) maxEdgeRate="$RATE" || exit 1
+BUTTON=/sys/kernel/button/gpio$BASE
+
+echo "Storming gpio$BASE for $DURATION s with $TOGGLERS togglers (maxEdgeRate = $RATE)"
+
+PIDS=""
+for i in $(seq "$TOGGLERS"); do
+    ( while :; do echo pull-up > "$PULL"; echo pull-down > "$PULL"; done ) 2>/dev/null &
+    PIDS="$PIDS $!"
+done
+
+# Measures how late a 10 ms sleep wakes up while the storm is running
+WORST=0
+END=$(($(date +%s) + DURATION))
+while [ "$(date +%s)" -lt "$END" ]; do
+    START=$(date +%s%N)
+    sleep 0.01
+    LATE=$(( ($(date +%s%N) - START) / 1000000 - 10 ))
+    [ "$LATE" -gt "$WORST" ] && WORST=$LATE
+done
+
+for pid in $PIDS; do kill "$pid" 2>/dev/null; done
+wait 2>/dev/null
+PIDS=""
+
+echo "numberPresses: $(cat "$BUTTON/numberPresses")"
+echo "coalescedEdges: $(cat "$BUTTON/coalescedEdges")"
+echo "throttleCount: $(cat "$BUTTON/throttleCount")"
+echo "worst wake-up latency: $WORST ms"
+
+if [ "$WORST" -gt "$MAX_LATENCY_MS" ]; then
+    echo "FAIL"
+    exit 1
+fi
+echo "PASS"
@@ -0,0 +1,554 @@
+/*
+ *  bench.c - In-kernel micro-benchmarks for the design choices behind the char and GPIO
+ *  modules: memory allocation, copy_to_user, printk against tracepoints and shared counters.
+ *
+ *  The test is selected with the module parameters, which can be changed at
+ *  /sys/module/bench/parameters/. Writing 1 to /sys/kernel/bench/run runs it, and
+ *  /sys/kernel/bench/result shows the outcome as a single line of key=value pairs.
+ */
+
+#include <linux/module.h>	/* Needed by all modules */
+#include <linux/kernel.h>	/* Needed for KERN_INFO */
+#include <linux/init.h>		/* Needed for the macros, e.g. __init, __exit */
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/completion.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/atomic.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/mman.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+
+#define CREATE_TRACE_POINTS
+#include "bench_trace.h"
+
+#define TEST_NAME_LEN 16
+#define MAX_SIZE KMALLOC_MAX_SIZE	// largest block the page allocator hands out
+#define RESCHED_INTERVAL 1024		// operations between two cond_resched() of a run
+
+MODULE_LICENSE("GPL");                  // License type
+MODULE_AUTHOR("Maíra Canal");           // Author name
+MODULE_DESCRIPTION("In-kernel micro-benchmarks with educational intentions"); // Module description
+MODULE_VERSION("0.0.1");                // Module version
+
+static char *test = "kmalloc";
+module_param(test, charp, 0644);
+MODULE_PARM_DESC(test, "Test to run: kmalloc, kmem_cache, pages, copy_to_user, printk, "
+		 "tracepoint, spinlock, atomic or percpu (default = kmalloc)");
+
+static unsigned int iterations = 100000;
+module_param(iterations, uint, 0644);
+MODULE_PARM_DESC(iterations, "Operations done by each thread (default = 100000)");
+
+static unsigned int threads = 1;
+module_param(threads, uint, 0644);
+MODULE_PARM_DESC(threads, "Number of kthreads running the test at the same time, each bound to its own "
+		 "online CPU (default = 1)");
+
+static unsigned int size = 64;
+module_param(size, uint, 0644);
+MODULE_PARM_DESC(size, "Bytes allocated or copied by each operation (default = 64)");
+
+struct bench_test;
+
+/**
+ * @brief The parameters of a run, copied once under kernel_param_lock() so that changing the
+ * module parameters while a test runs does not affect it
+ */
+struct bench_ctx {
+	const struct bench_test *test;
+	unsigned int iterations;
+	unsigned int threads;
+	unsigned int size;
+};
+
+/**
+ * @brief A benchmark
+ *
+ * run() is called by every thread and does ctx->iterations operations. setup() and
+ * teardown(), when present, are called once around all the threads. Tests marked as
+ * inCaller run in the process that wrote to /sys/kernel/bench/run, with a single thread.
+ */
+struct bench_test {
+	const char *name;
+	int (*setup)(const struct bench_ctx *ctx);
+	int (*run)(const struct bench_ctx *ctx);
+	void (*teardown)(const struct bench_ctx *ctx);
+	bool inCaller;
+};
+
+struct bench_thread {
+	struct task_struct *task;
+	u64 ns;
+};
+
+static DEFINE_MUTEX(bench_mutex);	// serializes the runs and protects lastResult and benchCpus
+static char lastResult[512] = "none\n";
+static struct cpumask benchCpus;	// CPUs the last run was placed on
+
+static DECLARE_COMPLETION(startAll);
+static DECLARE_COMPLETION(allDone);
+static atomic_t runningThreads;
+static const struct bench_ctx *currentCtx;
+
+// Shared state of the tests, set up before each run
+static struct kmem_cache *benchCache;
+static unsigned long userBuffer;
+static char *kernelBuffer;
+static DEFINE_SPINLOCK(counterLock);
+static unsigned long lockedCounter;
+static atomic_long_t atomicCounter;
+static DEFINE_PER_CPU(unsigned long, percpuCounter);
+
+// ******************************************************************************************* Tests
+
+// Lets a long run give up the CPU, between two operations so none of them is split
+static inline void bench_resched(unsigned int n) {
+	if (!(n % RESCHED_INTERVAL))
+		cond_resched();
+}
+
+static int kmalloc_run(const struct bench_ctx *ctx) {
+	unsigned int n = ctx->iterations;
+	void *ptr;
+
+	while (n--) {
+		ptr = kmalloc(ctx->size, GFP_KERNEL);
+		if (!ptr)
+			return -ENOMEM;
+		kfree(ptr);
+		bench_resched(n);
+	}
+	return 0;
+}
+
+static int kmem_cache_setup(const struct bench_ctx *ctx) {
+	benchCache = kmem_cache_create("bench_cache", ctx->size, 0, 0, NULL);
+	return benchCache ? 0 : -ENOMEM;
+}
+
+static int kmem_cache_run(const struct bench_ctx *ctx) {
+	unsigned int n = ctx->iterations;
+	void *ptr;
+
+	while (n--) {
+		ptr = kmem_cache_alloc(benchCache, GFP_KERNEL);
+		if (!ptr)
+			return -ENOMEM;
+		kmem_cache_free(benchCache, ptr);
+		bench_resched(n);
+	}
+	return 0;
+}
+
+static void kmem_cache_teardown(const struct bench_ctx *ctx) {
+	kmem_cache_destroy(benchCache);
+}
+
+static int pages_run(const struct bench_ctx *ctx) {
+	unsigned int order = get_order(ctx->size);
+	unsigned int n = ctx->iterations;
+	struct page *page;
+
+	while (n--) {
+		page = alloc_pages(GFP_KERNEL, order);
+		if (!page)
+			return -ENOMEM;
+		__free_pages(page, order);
+		bench_resched(n);
+	}
+	return 0;
+}
+
+static void copy_to_user_teardown(const struct bench_ctx *ctx) {
+	if (!IS_ERR_VALUE(userBuffer))
+		vm_munmap(userBuffer, PAGE_ALIGN(ctx->size));
+	kvfree(kernelBuffer);
+}
+
+// Maps a buffer in the calling process and faults it in before the timed run
+static int copy_to_user_setup(const struct bench_ctx *ctx) {
+	kernelBuffer = kvzalloc(ctx->size, GFP_KERNEL);
+	userBuffer = vm_mmap(NULL, 0, PAGE_ALIGN(ctx->size), PROT_READ | PROT_WRITE,
+			     MAP_ANONYMOUS | MAP_PRIVATE, 0);
+
+	if (!kernelBuffer || IS_ERR_VALUE(userBuffer) ||
+	    copy_to_user((void __user *) userBuffer, kernelBuffer, ctx->size)) {
+		copy_to_user_teardown(ctx);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static int copy_to_user_run(const struct bench_ctx *ctx) {
+	unsigned int n = ctx->iterations;
+
+	while (n--) {
+		if (copy_to_user((void __user *) userBuffer, kernelBuffer, ctx->size))
+			return -EFAULT;
+		bench_resched(n);
+	}
+	return 0;
+}
+
+static int printk_run(const struct bench_ctx *ctx) {
+	unsigned int n = ctx->iterations;
+
+	while (n--) {
+		printk(KERN_DEBUG "BENCH: iteration %u\n", n);
+		bench_resched(n);
+	}
+	return 0;
+}
+
+static int tracepoint_run(const struct bench_ctx *ctx) {
+	unsigned int n = ctx->iterations;
+
+	while (n--) {
+		trace_bench_event(n);
+		bench_resched(n);
+	}
+	return 0;
+}
+
+static int counters_setup(const struct bench_ctx *ctx) {
+	int cpu;
+
+	lockedCounter = 0;
+	atomic_long_set(&atomicCounter, 0);
+	for_each_possible_cpu(cpu)
+		per_cpu(percpuCounter, cpu) = 0;
+	return 0;
+}
+
+static int spinlock_run(const struct bench_ctx *ctx) {
+	unsigned int n = ctx->iterations;
+
+	while (n--) {
+		spin_lock(&counterLock);
+		lockedCounter++;
+		spin_unlock(&counterLock);
+		bench_resched(n);
+	}
+	return 0;
+}
+
+static int atomic_run(const struct bench_ctx *ctx) {
+	unsigned int n = ctx->iterations;
+
+	while (n--) {
+		atomic_long_inc(&atomicCounter);
+		bench_resched(n);
+	}
+	return 0;
+}
+
+static int percpu_run(const struct bench_ctx *ctx) {
+	unsigned int n = ctx->iterations;
+
+	while (n--) {
+		this_cpu_inc(percpuCounter);
+		bench_resched(n);
+	}
+	return 0;
+}
+
+static const struct bench_test tests[] = {
+	{ .name = "kmalloc", .run = kmalloc_run },
+	{ .name = "kmem_cache", .setup = kmem_cache_setup, .run = kmem_cache_run,
+	  .teardown = kmem_cache_teardown },
+	{ .name = "pages", .run = pages_run },
+	{ .name = "copy_to_user", .setup = copy_to_user_setup, .run = copy_to_user_run,
+	  .teardown = copy_to_user_teardown, .inCaller = true },
+	{ .name = "printk", .run = printk_run },
+	{ .name = "tracepoint", .run = tracepoint_run },
+	{ .name = "spinlock", .setup = counters_setup, .run = spinlock_run },
+	{ .name = "atomic", .setup = counters_setup, .run = atomic_run },
+	{ .name = "percpu", .setup = counters_setup, .run = percpu_run },
+};
+
+/** @brief Reads the value of the shared counter of the last counter test
+ *  @return returns the counter, which must be equal to the number of operations
+ */
+static unsigned long read_counter(const struct bench_test *bench) {
+	unsigned long sum = 0;
+	int cpu;
+
+	if (bench->run == spinlock_run)
+		return lockedCounter;
+	if (bench->run == atomic_run)
+		return atomic_long_read(&atomicCounter);
+
+	for_each_possible_cpu(cpu)
+		sum += per_cpu(percpuCounter, cpu);
+	return sum;
+}
+
+// ****************************************************************************************************************
+
+/** @brief Body of each benchmark thread. Waits for all the threads to be created, runs the
+ *  test and then stays around until bench_run_threads() collects it with kthread_stop().
+ *  @param data The struct bench_thread of this thread
+ *  @return returns the result of the test
+ */
+static int bench_thread_fn(void *data) {
+	struct bench_thread *thread = data;
+	ktime_t start;
+	int ret;
+
+	wait_for_completion(&startAll);
+
+	start = ktime_get();
+	ret = currentCtx->test->run(currentCtx);
+	thread->ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (atomic_dec_and_test(&runningThreads))
+		complete(&allDone);
+
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return ret;
+}
+
+/** @brief Runs the test in ctx->threads kthreads, all started at the same time. Thread i is
+ *  bound to the i-th online CPU, so the threads really contend with each other; the CPUs used
+ *  are left in benchCpus.
+ *  @param ctx The parameters of the run
+ *  @param benchThreads Array with ctx->threads entries that receives the time of each thread
+ *  @param wallNs Receives the time between the start and the end of the last thread
+ *  @return returns 0 if successful
+ */
+static int bench_run_threads(const struct bench_ctx *ctx, struct bench_thread *benchThreads, u64 *wallNs) {
+	unsigned int numThreads = ctx->threads;
+	unsigned int i, created;
+	ktime_t start;
+	int ret = 0, threadRet;
+	int cpu = -1;
+
+	reinit_completion(&startAll);
+	reinit_completion(&allDone);
+	atomic_set(&runningThreads, numThreads);
+	cpumask_clear(&benchCpus);
+
+	// Keeps the chosen CPUs online until the threads are collected
+	cpus_read_lock();
+
+	// bench_run() checked the CPUs, but some may have gone offline since
+	if (numThreads > num_online_cpus()) {
+		cpus_read_unlock();
+		return -EINVAL;
+	}
+
+	for (created = 0; created < numThreads; created++) {
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		benchThreads[created].task = kthread_create(bench_thread_fn, &benchThreads[created],
+							    "bench/%u", cpu);
+		if (IS_ERR(benchThreads[created].task)) {
+			ret = PTR_ERR(benchThreads[created].task);
+			break;
+		}
+		kthread_bind(benchThreads[created].task, cpu);
+		cpumask_set_cpu(cpu, &benchCpus);
+		get_task_struct(benchThreads[created].task);
+	}
+
+	if (ret) {
+		// A thread stopped before being woken up never runs bench_thread_fn()
+		for (i = 0; i < created; i++) {
+			kthread_stop(benchThreads[i].task);
+			put_task_struct(benchThreads[i].task);
+		}
+		cpus_read_unlock();
+		return ret;
+	}
+
+	// The threads wait at startAll, so the creation is left out of the measurement
+	for (i = 0; i < numThreads; i++)
+		wake_up_process(benchThreads[i].task);
+
+	start = ktime_get();
+	complete_all(&startAll);
+	wait_for_completion(&allDone);
+	*wallNs = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	for (i = 0; i < numThreads; i++) {
+		threadRet = kthread_stop(benchThreads[i].task);
+		put_task_struct(benchThreads[i].task);
+		if (threadRet && !ret)
+			ret = threadRet;
+	}
+
+	cpus_read_unlock();
+	return ret;
+}
+
+/** @brief Runs the test selected by the module parameters and writes its result
+ *  @return returns 0 if successful
+ */
+static int bench_run(void) {
+	struct bench_ctx ctx = { };
+	struct bench_thread *benchThreads;
+	char name[TEST_NAME_LEN];
+	u64 wallNs = 0, threadNs = 0, ops;
+	unsigned int i;
+	int ret;
+
+	kernel_param_lock(THIS_MODULE);
+	strscpy(name, test, sizeof(name));
+	ctx.iterations = iterations;
+	ctx.threads = threads;
+	ctx.size = size;
+	kernel_param_unlock(THIS_MODULE);
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++)
+		if (sysfs_streq(name, tests[i].name))
+			ctx.test = &tests[i];
+
+	if (!ctx.test || !ctx.iterations || !ctx.size || ctx.size > MAX_SIZE || !ctx.threads)
+		return -EINVAL;
+
+	if (ctx.test->inCaller)
+		ctx.threads = 1;
+
+	// Each thread needs its own CPU, checked before allocating anything for them
+	if (ctx.threads > num_online_cpus()) {
+		printk(KERN_ALERT "BENCH: %u threads but only %u online CPUs\n", ctx.threads, num_online_cpus());
+		return -EINVAL;
+	}
+
+	benchThreads = kcalloc(ctx.threads, sizeof(*benchThreads), GFP_KERNEL);
+	if (!benchThreads)
+		return -ENOMEM;
+
+	currentCtx = &ctx;
+	ret = ctx.test->setup ? ctx.test->setup(&ctx) : 0;
+	if (ret)
+		goto out;
+
+	if (ctx.test->inCaller) {
+		ktime_t start = ktime_get();
+
+		cpumask_clear(&benchCpus);
+		cpumask_set_cpu(raw_smp_processor_id(), &benchCpus);
+		ret = ctx.test->run(&ctx);
+		benchThreads[0].ns = wallNs = ktime_to_ns(ktime_sub(ktime_get(), start));
+	} else {
+		ret = bench_run_threads(&ctx, benchThreads, &wallNs);
+	}
+
+	if (!ret) {
+		ops = (u64) ctx.iterations * ctx.threads;
+		for (i = 0; i < ctx.threads; i++)
+			threadNs += benchThreads[i].ns;
+
+		i = scnprintf(lastResult, sizeof(lastResult),
+			      "test=%s threads=%u iterations=%u size=%u cpus=%*pbl ops=%llu wall_ns=%llu ns_per_op=%llu ops_per_sec=%llu",
+			      ctx.test->name, ctx.threads, ctx.iterations, ctx.size, cpumask_pr_args(&benchCpus),
+			      ops, wallNs, div64_u64(threadNs, ops),
+			      wallNs ? mul_u64_u64_div_u64(ops, NSEC_PER_SEC, wallNs) : 0);
+		if (ctx.test->setup == counters_setup)
+			i += scnprintf(lastResult + i, sizeof(lastResult) - i, " counter=%lu", read_counter(ctx.test));
+		scnprintf(lastResult + i, sizeof(lastResult) - i, "\n");
+
+		printk(KERN_INFO "BENCH: %s", lastResult);
+	}
+
+	if (ctx.test->teardown)
+		ctx.test->teardown(&ctx);
+
+out:
+	currentCtx = NULL;
+	kfree(benchThreads);
+	return ret;
+}
+
+static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+	bool doRun;
+	int ret;
+
+	ret = kstrtobool(buf, &doRun);
+	if (ret)
+		return ret;
+	if (!doRun)
+		return count;
+
+	if (mutex_lock_interruptible(&bench_mutex))
+		return -EINTR;
+
+	ret = bench_run();
+	if (ret)
+		scnprintf(lastResult, sizeof(lastResult), "error=%d\n", ret);
+
+	mutex_unlock(&bench_mutex);
+
+	return ret ? ret : count;
+}
+
+static ssize_t result_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+	ssize_t len;
+
+	mutex_lock(&bench_mutex);
+	len = sprintf(buf, "%s", lastResult);
+	mutex_unlock(&bench_mutex);
+
+	return len;
+}
+
+static struct kobj_attribute run_attr = __ATTR_WO(run);
+static struct kobj_attribute result_attr = __ATTR_RO(result);
+
+static struct attribute *attrs[] = {&run_attr.attr, &result_attr.attr, NULL};
+
+static struct attribute_group attr_group = {
+	.attrs = attrs,
+};
+
+static struct kobject *bench_kobj;
+
+/** @brief LKM initialization function
+ *  Creates /sys/kernel/bench, where the benchmarks are run from.
+ *  @return returns 0 if successful
+ */
+static int __init bench_init(void)
+{
+	int ret;
+
+	bench_kobj = kobject_create_and_add("bench", kernel_kobj);
+	if (!bench_kobj)
+		return -ENOMEM;
+
+	ret = sysfs_create_group(bench_kobj, &attr_group);
+	if (ret) {
+		kobject_put(bench_kobj);
+		return ret;
+	}
+
+	printk(KERN_INFO "BENCH: ready, write 1 to /sys/kernel/bench/run\n");
+	return 0;
+}
+
+/** @brief LKM cleanup function
+ */
+static void __exit bench_exit(void)
+{
+	kobject_put(bench_kobj);
+	printk(KERN_INFO "BENCH: Goodbye\n");
+}
+
+module_init(bench_init);
+module_exit(bench_exit);
@@ -0,0 +1,32 @@
+/*
+ *  bench_trace.h - Tracepoint used to measure the cost of tracing against printk.
+ *  Enable it with: echo 1 > /sys/kernel/tracing/events/bench/bench_event/enable
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM bench
+
+#if !defined(_BENCH_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BENCH_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(bench_event,
+	TP_PROTO(unsigned int iteration),
+	TP_ARGS(iteration),
+	TP_STRUCT__entry(
+		__field(unsigned int, iteration)
+	),
+	TP_fast_assign(
+		__entry->iteration = iteration;
+	),
+	TP_printk("iteration=%u", __entry->iteration)
+);
+
+#endif /* _BENCH_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE bench_trace
+#include <trace/define_trace.h>